@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <WindowRenderer/windowrenderer.h>
+#include <libwr.h>
+
+#define LOG_IMPLEMENTATION
+#include "log.h"
+
+/*
+ * Measures how many connections and commands per second the server
+ * handles with many clients at once. Every client connects, creates a
+ * window, then damages it once per round trip, and then again with all
+ * its commands pipelined. The phases start together on every client.
+ *
+ * Usage: BenchClient [clients] [commands per client]
+ */
+
+typedef struct {
+    pthread_barrier_t* barrier;
+    int commands_count;
+    bool failed;
+} Client;
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static bool run_round_trips(int serverfd, int window_id, int commands_count)
+{
+    for (int i = 0; i < commands_count; ++i) {
+        if (!wr_damage_window(serverfd, window_id, 0, 0, 1, 1))
+            return false;
+    }
+
+    return true;
+}
+
+static bool run_pipelined(int serverfd, int window_id, int commands_count)
+{
+    uint32_t* request_ids = malloc(commands_count * sizeof(*request_ids));
+    bool result = true;
+
+    for (int i = 0; i < commands_count; ++i) {
+        request_ids[i] = wr_submit_damage_window(serverfd, window_id, 0, 0, 1, 1);
+        if (request_ids[i] == WR_REQUEST_ID_INVALID) {
+            result = false;
+            goto defer;
+        }
+    }
+
+    if (!wr_flush(serverfd)) {
+        result = false;
+        goto defer;
+    }
+
+    for (int i = 0; i < commands_count; ++i) {
+        WindowRendererResponse response;
+        if (!wr_collect(serverfd, request_ids[i], &response)
+            || response.status != WRSTATUS_OK) {
+            result = false;
+            goto defer;
+        }
+    }
+
+defer:
+    free(request_ids);
+    return result;
+}
+
+static void* client_run(void* data)
+{
+    Client* client = data;
+    int serverfd = -1;
+    int window_id = -1;
+
+    // Connecting
+    pthread_barrier_wait(client->barrier);
+    serverfd = wr_server_connect();
+    if (serverfd != -1)
+        window_id = wr_create_window(serverfd, "Bench", 1, 1);
+    client->failed = window_id == -1;
+    pthread_barrier_wait(client->barrier);
+
+    // Round trips
+    pthread_barrier_wait(client->barrier);
+    if (!client->failed && !run_round_trips(serverfd, window_id, client->commands_count))
+        client->failed = true;
+    pthread_barrier_wait(client->barrier);
+
+    // Pipelined
+    pthread_barrier_wait(client->barrier);
+    if (!client->failed && !run_pipelined(serverfd, window_id, client->commands_count))
+        client->failed = true;
+    pthread_barrier_wait(client->barrier);
+
+    if (window_id != -1)
+        wr_close_window(serverfd, window_id);
+    if (serverfd != -1)
+        wr_server_disconnect(serverfd);
+
+    return NULL;
+}
+
+// Runs a phase on every client, and returns how long it took. The clients
+// may get to run before this thread wakes up, so the phase starts before
+// they are released
+static double run_phase(pthread_barrier_t* barrier)
+{
+    double start = now();
+    pthread_barrier_wait(barrier);
+    pthread_barrier_wait(barrier);
+    return now() - start;
+}
+
+int main(int argc, char const** argv)
+{
+    int clients_count = argc > 1 ? atoi(argv[1]) : 100;
+    int commands_count = argc > 2 ? atoi(argv[2]) : 1000;
+
+    if (clients_count <= 0 || commands_count <= 0) {
+        log_log(LOG_ERROR, "Invalid client or command count");
+        return 1;
+    }
+
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, clients_count + 1);
+
+    Client* clients = malloc(clients_count * sizeof(*clients));
+    pthread_t* threads = malloc(clients_count * sizeof(*threads));
+
+    for (int i = 0; i < clients_count; ++i) {
+        clients[i] = (Client) {
+            .barrier = &barrier,
+            .commands_count = commands_count,
+        };
+        pthread_create(&threads[i], NULL, client_run, &clients[i]);
+    }
+
+    double connect_time = run_phase(&barrier);
+    double round_trips_time = run_phase(&barrier);
+    double pipelined_time = run_phase(&barrier);
+
+    int failed_count = 0;
+    for (int i = 0; i < clients_count; ++i) {
+        pthread_join(threads[i], NULL);
+        failed_count += clients[i].failed;
+    }
+
+    double commands_total = (double)clients_count * commands_count;
+
+    printf("%d clients, %d commands each, %d failed\n",
+           clients_count, commands_count, failed_count);
+    printf("  connect + create window: %8.1f ms, %10.0f clients/s\n",
+           connect_time * 1e3, clients_count / connect_time);
+    printf("  round trips:             %8.1f ms, %10.0f commands/s\n",
+           round_trips_time * 1e3, commands_total / round_trips_time);
+    printf("  pipelined:               %8.1f ms, %10.0f commands/s\n",
+           pipelined_time * 1e3, commands_total / pipelined_time);
+
+    pthread_barrier_destroy(&barrier);
+    free(threads);
+    free(clients);
+
+    return failed_count == 0 ? 0 : 1;
+}
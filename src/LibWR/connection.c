@@ -0,0 +1,211 @@
+#include "connection.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "log.h"
+
+static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Connection** connections = NULL;
+static size_t connections_count = 0;
+static size_t connections_capacity = 0;
+
+Connection* connection_register(int fd)
+{
+    Connection* connection = malloc(sizeof(*connection));
+    memset(connection, 0, sizeof(*connection));
+
+    connection->fd = fd;
+    connection->next_request_id = WR_REQUEST_ID_INVALID + 1;
+    connection->event_ring_wakeup_fd = -1;
+    connection->event_ring_space_fd = -1;
+
+    pthread_mutex_lock(&connections_mutex);
+
+    if (connections_count == connections_capacity) {
+        connections_capacity = connections_capacity == 0 ? 4 : connections_capacity * 2;
+        connections = realloc(connections, connections_capacity * sizeof(*connections));
+    }
+    connections[connections_count++] = connection;
+
+    pthread_mutex_unlock(&connections_mutex);
+
+    return connection;
+}
+
+void connection_unregister(int fd)
+{
+    pthread_mutex_lock(&connections_mutex);
+
+    for (size_t i = 0; i < connections_count; ++i) {
+        if (connections[i]->fd == fd) {
+            Connection* connection = connections[i];
+            connections[i] = connections[--connections_count];
+
+            free(connection->queued);
+            free(connection->stashed);
+            free(connection->events);
+
+            if (connection->event_ring) {
+                munmap(connection->event_ring, connection->event_ring_size);
+                close(connection->event_ring_wakeup_fd);
+                close(connection->event_ring_space_fd);
+            }
+
+            free(connection);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&connections_mutex);
+}
+
+Connection* connection_get(int fd)
+{
+    Connection* connection = NULL;
+
+    pthread_mutex_lock(&connections_mutex);
+
+    for (size_t i = 0; i < connections_count; ++i) {
+        if (connections[i]->fd == fd) {
+            connection = connections[i];
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&connections_mutex);
+
+    return connection;
+}
+
+uint32_t connection_next_request_id(Connection* connection)
+{
+    uint32_t request_id = connection->next_request_id++;
+    if (connection->next_request_id == WR_REQUEST_ID_INVALID)
+        connection->next_request_id++;
+
+    return request_id;
+}
+
+uint32_t connection_queue_command(Connection* connection, WindowRendererCommand command,
+                                  int const* fds, size_t fds_count)
+{
+    if (connection->queued_count == connection->queued_capacity) {
+        connection->queued_capacity = connection->queued_capacity == 0
+            ? 16
+            : connection->queued_capacity * 2;
+        connection->queued = realloc(connection->queued,
+                                     connection->queued_capacity * sizeof(*connection->queued));
+    }
+
+    command.request_id = connection_next_request_id(connection);
+    command.fd_count = fds_count;
+
+    QueuedCommand* queued = &connection->queued[connection->queued_count++];
+    queued->command = command;
+    memcpy(queued->fds, fds, fds_count * sizeof(*fds));
+
+    return command.request_id;
+}
+
+void connection_stash_response(Connection* connection, WindowRendererResponse response)
+{
+    if (connection->stashed_count == connection->stashed_capacity) {
+        connection->stashed_capacity = connection->stashed_capacity == 0
+            ? 16
+            : connection->stashed_capacity * 2;
+        connection->stashed = realloc(connection->stashed,
+                                      connection->stashed_capacity * sizeof(*connection->stashed));
+    }
+
+    connection->stashed[connection->stashed_count++] = response;
+}
+
+bool connection_take_stashed_response(Connection* connection, uint32_t request_id,
+                                      WindowRendererResponse* response)
+{
+    for (size_t i = 0; i < connection->stashed_count; ++i) {
+        if (connection->stashed[i].request_id == request_id) {
+            *response = connection->stashed[i];
+            connection->stashed[i] = connection->stashed[--connection->stashed_count];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void connection_queue_event(Connection* connection, WindowRendererEvent event)
+{
+    size_t end = connection->events_start + connection->events_count;
+
+    if (end == connection->events_capacity) {
+        if (connection->events_start != 0) {
+            memmove(connection->events, connection->events + connection->events_start,
+                    connection->events_count * sizeof(*connection->events));
+            connection->events_start = 0;
+        } else {
+            connection->events_capacity = connection->events_capacity == 0
+                ? 16
+                : connection->events_capacity * 2;
+            connection->events = realloc(connection->events,
+                                         connection->events_capacity * sizeof(*connection->events));
+        }
+        end = connection->events_start + connection->events_count;
+    }
+
+    connection->events[end] = event;
+    connection->events_count++;
+}
+
+bool connection_take_queued_event(Connection* connection, WindowRendererEvent* event)
+{
+    if (connection->events_count == 0)
+        return false;
+
+    *event = connection->events[connection->events_start];
+    connection->events_count--;
+    connection->events_start = connection->events_count == 0
+        ? 0
+        : connection->events_start + 1;
+
+    return true;
+}
+
+bool connection_take_ring_event(Connection* connection, WindowRendererEvent* event)
+{
+    WindowRendererEventRing* ring = connection->event_ring;
+    if (!ring)
+        return false;
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail)
+        return false;
+
+    *event = ring->events[head & (connection->event_ring_capacity - 1)];
+
+    // Hands the slot back to the server
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // Either the server sees the room we made, or we see that it gave up
+    // waiting for it
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&ring->server_waiting, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->server_waiting, 0, memory_order_relaxed);
+
+        uint64_t value = 1;
+        if (write(connection->event_ring_space_fd, &value, sizeof(value)) == -1) {
+            log_log(LOG_WARNING, "Could not notify the server about free event slots: %s",
+                    strerror(errno));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WindowRenderer/windowrenderer.h"
+
+#define CONNECTION_RECEIVE_BUFFER_SIZE 4096
+
+typedef struct {
+    WindowRendererCommand command;
+    int fds[WR_COMMAND_FDS_MAX];
+} QueuedCommand;
+
+/*
+ * Client-side state of a connection to the server, looked up by the
+ * socket file descriptor that is handed out to the user.
+ */
+typedef struct {
+    int fd;
+
+    uint32_t next_request_id;
+
+    // Bytes received but not yet decoded into whole messages
+    unsigned char receive_buffer[CONNECTION_RECEIVE_BUFFER_SIZE];
+    size_t receive_start;
+    size_t receive_size;
+
+    // Commands submitted but not sent yet
+    QueuedCommand* queued;
+    size_t queued_count;
+    size_t queued_capacity;
+
+    // Responses received while waiting for another one, kept until they
+    // are collected
+    WindowRendererResponse* stashed;
+    size_t stashed_count;
+    size_t stashed_capacity;
+
+    // Events received while waiting for a response, oldest first
+    WindowRendererEvent* events;
+    size_t events_start;
+    size_t events_count;
+    size_t events_capacity;
+
+    // Set up by `wr_event_ring_enable`. Once set, the server writes every
+    // new event there instead of sending it
+    WindowRendererEventRing* event_ring;
+    size_t event_ring_size;
+    uint32_t event_ring_capacity;
+    int event_ring_wakeup_fd;
+    int event_ring_space_fd;
+} Connection;
+
+Connection* connection_register(int fd);
+void connection_unregister(int fd);
+
+// Returns NULL if `fd` was not returned by `wr_server_connect`
+Connection* connection_get(int fd);
+
+uint32_t connection_next_request_id(Connection* connection);
+
+// Returns the request ID assigned to the command
+uint32_t connection_queue_command(Connection* connection, WindowRendererCommand command,
+                                  int const* fds, size_t fds_count);
+
+void connection_stash_response(Connection* connection, WindowRendererResponse response);
+// Returns false if no response with the given request ID was stashed
+bool connection_take_stashed_response(Connection* connection, uint32_t request_id,
+                                      WindowRendererResponse* response);
+
+void connection_queue_event(Connection* connection, WindowRendererEvent event);
+// Returns false if there are no queued events
+bool connection_take_queued_event(Connection* connection, WindowRendererEvent* event);
+// Returns false if the event ring is empty (or not set up)
+bool connection_take_ring_event(Connection* connection, WindowRendererEvent* event);
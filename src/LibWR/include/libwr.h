@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <WindowRenderer/windowrenderer.h>
 
@@ -25,9 +26,101 @@ bool wr_close_window(int serverfd, int id);
 // Returns false on error
 bool wr_set_window_dma_buf(int serverfd, int window_id, WRDmaBuf dma_buf);
 
-// Returns -1 on error, otherwise returns eventfd
-int wr_event_connect(int window_id);
-bool wr_event_disconnect(int eventfd);
+/*
+ * Multi-buffering
+ *
+ * A window may have up to WR_WINDOW_BUFFERS_MAX buffers, put in slots
+ * with `wr_set_window_buffer`. The client draws into one that isn't
+ * shown, then shows it with `wr_commit_window`, passing the part that
+ * changed since the last commit. The buffer shown before gets a
+ * WREVENT_BUFFER_RELEASE event once the server stopped reading from
+ * it, and can be drawn into again after that. The server never reads
+ * from a buffer while the client draws into it, so there's no tearing.
+ *
+ * `acquire_fence` is a sync_file fence signaled once the drawing into
+ * the buffer is done (see `wrgl_context_create_fence`), or -1 if it's
+ * already done. The caller keeps ownership of it.
+ *
+ * Both return false on error
+ */
+bool wr_set_window_buffer(int serverfd, int window_id, uint32_t buffer, WRDmaBuf dma_buf);
+bool wr_commit_window(int serverfd, int window_id, uint32_t buffer,
+                      int x, int y, int width, int height, int acquire_fence);
+
+/*
+ * Tells the server that the given part of the window's content changed.
+ * The server only redraws what changed, so call this after drawing into
+ * the window's buffer.
+ *
+ * Returns false on error
+ */
+bool wr_damage_window(int serverfd, int window_id, int x, int y, int width, int height);
+
+/*
+ * Makes the server send a WREVENT_FRAME_DONE event once the window's
+ * content, as of this call, is shown on screen. Send it with the damage
+ * of every frame to render exactly once per displayed frame: the event
+ * tells when the frame was shown and when the next one will be.
+ *
+ * Returns false on error
+ */
+bool wr_request_frame(int serverfd, int window_id);
+
+/*
+ * Pipelined commands
+ *
+ * The `wr_submit_*` functions queue a command without sending it and
+ * return its request ID (WR_REQUEST_ID_INVALID on error). `wr_flush`
+ * sends every queued command at once, and `wr_collect` waits for the
+ * response of a given request, in any order. This lets a client issue
+ * many commands while paying for a single round trip.
+ *
+ * File descriptors passed to `wr_submit_set_window_dma_buf` must stay
+ * open until the command is flushed.
+ *
+ * The response of every submitted command must be collected, even if
+ * it isn't needed. Responses are kept until they are collected, and the
+ * ones that are kept slow down every `wr_collect`.
+ */
+
+uint32_t wr_submit_create_window(int serverfd, char const* title, int width, int height);
+uint32_t wr_submit_close_window(int serverfd, int id);
+uint32_t wr_submit_set_window_dma_buf(int serverfd, int window_id, WRDmaBuf dma_buf);
+uint32_t wr_submit_set_window_buffer(int serverfd, int window_id, uint32_t buffer,
+                                     WRDmaBuf dma_buf);
+uint32_t wr_submit_commit_window(int serverfd, int window_id, uint32_t buffer,
+                                 int x, int y, int width, int height, int acquire_fence);
+uint32_t wr_submit_damage_window(int serverfd, int window_id,
+                                 int x, int y, int width, int height);
+uint32_t wr_submit_request_frame(int serverfd, int window_id);
 
 // Returns false on error
-bool wr_event_receive(int eventfd, WindowRendererEvent* event);
+bool wr_flush(int serverfd);
+
+// Flushes queued commands if needed. Returns false on error
+bool wr_collect(int serverfd, uint32_t request_id, WindowRendererResponse* response);
+
+/*
+ * Events of every window created by the client are received on the
+ * server connection. `event->window_id` tells which window an event
+ * belongs to.
+ *
+ * Returns false on error
+ */
+bool wr_event_receive(int serverfd, WindowRendererEvent* event);
+
+// Returns true and stores the oldest event in `event` if there is one,
+// returns false otherwise. Never blocks
+bool wr_event_poll(int serverfd, WindowRendererEvent* event);
+
+/*
+ * Makes the server write events to a ring of `capacity` events shared
+ * with the client, instead of sending them on the connection. After
+ * this, `wr_event_poll` doesn't make any system call, and
+ * `wr_event_receive` only makes some when there are no events.
+ *
+ * `capacity` must be a power of two, up to WR_EVENT_RING_CAPACITY_MAX.
+ *
+ * Returns false on error
+ */
+bool wr_event_ring_enable(int serverfd, uint32_t capacity);
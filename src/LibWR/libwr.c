@@ -1,10 +1,17 @@
+#define _GNU_SOURCE
+
 #include "libwr.h"
 
+#include "connection.h"
 #include "log.h"
 #include "server_session.h"
+#include "wire.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -12,85 +19,171 @@
 
 #include "WindowRenderer/windowrenderer.h"
 
-static bool send_command(int sockfd, WindowRendererCommand command, int sent_fd)
+/*
+ * Reads whatever the server sent into the connection's receive buffer.
+ * Returns -1 on error, otherwise the amount of bytes read, which can be
+ * 0 if `flags` has MSG_DONTWAIT.
+ */
+static ssize_t receive_bytes(Connection* connection, int flags)
 {
-    struct msghdr message_header = { 0 };
-
-    struct iovec io_vector = {
-        .iov_base = &command,
-        .iov_len = sizeof(command),
-    };
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
-
-    if (sent_fd != -1) {
-        char control_message_buffer[CMSG_SPACE(sizeof(sent_fd))];
-        memset(control_message_buffer, 0, sizeof(control_message_buffer));
+    if (connection->receive_start != 0) {
+        memmove(connection->receive_buffer,
+                connection->receive_buffer + connection->receive_start,
+                connection->receive_size);
+        connection->receive_start = 0;
+    }
 
-        struct cmsghdr* control_message = (struct cmsghdr*)control_message_buffer;
-        control_message->cmsg_level = SOL_SOCKET;
-        control_message->cmsg_type = SCM_RIGHTS;
-        control_message->cmsg_len = CMSG_LEN(sizeof(sent_fd));
+    ssize_t received = recv(connection->fd, connection->receive_buffer + connection->receive_size,
+                            sizeof(connection->receive_buffer) - connection->receive_size, flags);
 
-        memcpy(CMSG_DATA(control_message), &sent_fd, sizeof(sent_fd));
+    if (received == -1 && (flags & MSG_DONTWAIT) && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
 
-        message_header.msg_control = control_message;
-        message_header.msg_controllen = sizeof(control_message_buffer);
+    if (received <= 0) {
+        log_log(LOG_ERROR, "Could not receive data from the server: %s",
+                received == 0 ? "connection closed" : strerror(errno));
+        return -1;
     }
 
-    if (sendmsg(sockfd, &message_header, 0) == -1) {
-        log_log(LOG_ERROR, "Could not send command to the server: %s",
-                strerror(errno));
-        return false;
-    }
+    connection->receive_size += received;
+    return received;
+}
 
-    return true;
+/*
+ * Decodes every whole message in the receive buffer and stores it in the
+ * connection: events are queued, and responses are stashed. Batch
+ * responses need no special care, since their sub-responses are regular
+ * messages.
+ *
+ * Returns -1 on error, otherwise the amount of messages stored.
+ */
+static int store_received_messages(Connection* connection)
+{
+    int stored = 0;
+
+    while (true) {
+        unsigned char const* frame = connection->receive_buffer + connection->receive_start;
+
+        size_t frame_size;
+        WindowRendererFrameStatus status = wr_check_frame(frame, connection->receive_size,
+                                                          &frame_size);
+        if (status == WR_FRAME_INCOMPLETE)
+            return stored;
+
+        WindowRendererMessage message;
+        if (status == WR_FRAME_INVALID || !wire_decode_message(frame, &message)) {
+            log_log(LOG_ERROR, "Received an invalid message from the server");
+            return -1;
+        }
+
+        connection->receive_start += frame_size;
+        connection->receive_size -= frame_size;
+
+        if (message.kind == WRMSG_RESPONSE) {
+            if (message.message.response.kind != WRRESP_BATCH)
+                connection_stash_response(connection, message.message.response);
+        } else {
+            connection_queue_event(connection, message.message.event);
+        }
+
+        stored += 1;
+    }
 }
 
-static bool recv_response(int sockfd, WindowRendererResponse* response)
+/*
+ * Sends `count` commands and their file descriptors as a single message.
+ * Responses that arrive meanwhile are read and stored: the server stops
+ * reading commands while it can't send their responses, so waiting for
+ * the whole message to be sent without reading them could block both
+ * sides forever.
+ */
+static bool send_commands(Connection* connection, WindowRendererCommand* commands, size_t count,
+                          int* sent_fds, size_t sent_fds_count)
 {
-    struct msghdr message_header = { 0 };
+    unsigned char data[(WR_BATCH_COMMANDS_MAX + 1) * WIRE_COMMAND_SIZE_MAX];
+    size_t size = 0;
 
-    struct iovec io_vector = {
-        .iov_base = response,
-        .iov_len = sizeof(*response)
-    };
+    for (size_t i = 0; i < count; ++i) {
+        size += wire_encode_command(&data[size], &commands[i]);
+    }
 
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * WR_BATCH_COMMANDS_MAX * WR_COMMAND_FDS_MAX)];
+        struct cmsghdr align;
+    } control_message_buffer;
+    memset(&control_message_buffer, 0, sizeof(control_message_buffer));
 
-    int num_of_bytes_recvd = recvmsg(sockfd, &message_header, 0);
+    if (sent_fds_count != 0) {
+        struct cmsghdr* control_message = &control_message_buffer.align;
+        control_message->cmsg_level = SOL_SOCKET;
+        control_message->cmsg_type = SCM_RIGHTS;
+        control_message->cmsg_len = CMSG_LEN(sizeof(int) * sent_fds_count);
 
-    if (num_of_bytes_recvd <= 0) {
-        log_log(LOG_ERROR, "Could not receive data from the server: %s",
-                strerror(errno));
-        return false;
+        memcpy(CMSG_DATA(control_message), sent_fds, sizeof(int) * sent_fds_count);
+    }
+
+    size_t sent = 0;
+    while (sent < size) {
+        struct pollfd poll_fd = { .fd = connection->fd, .events = POLLIN | POLLOUT };
+        if (poll(&poll_fd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+
+            log_log(LOG_ERROR, "Could not wait for the server: %s", strerror(errno));
+            return false;
+        }
+
+        if (poll_fd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (receive_bytes(connection, MSG_DONTWAIT) == -1
+                || store_received_messages(connection) == -1)
+                return false;
+        }
+
+        if (!(poll_fd.revents & POLLOUT))
+            continue;
+
+        struct msghdr message_header = { 0 };
+
+        struct iovec io_vector = {
+            .iov_base = data + sent,
+            .iov_len = size - sent,
+        };
+        message_header.msg_iov = &io_vector;
+        message_header.msg_iovlen = 1;
+
+        // The file descriptors go along with the first bytes sent
+        if (sent_fds_count != 0 && sent == 0) {
+            message_header.msg_control = &control_message_buffer.align;
+            message_header.msg_controllen = CMSG_SPACE(sizeof(int) * sent_fds_count);
+        }
+
+        ssize_t result = sendmsg(connection->fd, &message_header, MSG_DONTWAIT);
+        if (result == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+
+            log_log(LOG_ERROR, "Could not send command to the server: %s",
+                    strerror(errno));
+            return false;
+        }
+
+        sent += result;
     }
 
     return true;
 }
 
-static bool recv_event(int sockfd, WindowRendererEvent* event)
+// Blocks until at least one message was received and stored
+static bool recv_and_store_message(Connection* connection)
 {
-    struct msghdr message_header = { 0 };
-
-    struct iovec io_vector = {
-        .iov_base = event,
-        .iov_len = sizeof(*event)
-    };
-
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
-
-    int num_of_bytes_recvd = recvmsg(sockfd, &message_header, 0);
+    while (true) {
+        int stored = store_received_messages(connection);
+        if (stored != 0)
+            return stored != -1;
 
-    if (num_of_bytes_recvd <= 0) {
-        log_log(LOG_ERROR, "Could not receive data from the server: %s",
-                strerror(errno));
-        return false;
+        if (receive_bytes(connection, 0) == -1)
+            return false;
     }
-
-    return true;
 }
 
 static bool is_response_valid(char const* command, WindowRendererResponseKind expected,
@@ -111,6 +204,15 @@ static bool is_response_valid(char const* command, WindowRendererResponseKind ex
     return true;
 }
 
+static Connection* get_connection(int serverfd)
+{
+    Connection* connection = connection_get(serverfd);
+    if (!connection) {
+        log_log(LOG_ERROR, "File descriptor `%d` is not a server connection", serverfd);
+    }
+    return connection;
+}
+
 int wr_server_connect()
 {
     if (!server_session_init()) {
@@ -135,11 +237,15 @@ int wr_server_connect()
         return -1;
     }
 
+    connection_register(sockfd);
+
     return sockfd;
 }
 
 bool wr_server_disconnect(int serverfd)
 {
+    connection_unregister(serverfd);
+
     if (close(serverfd) == -1) {
         log_log(LOG_ERROR, "Failed to close server socket");
         return false;
@@ -147,19 +253,206 @@ bool wr_server_disconnect(int serverfd)
     return true;
 }
 
-int wr_create_window(int serverfd, char const* title, int width, int height)
+uint32_t wr_submit_create_window(int serverfd, char const* title, int width, int height)
 {
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
     WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
     command.kind = WRCMD_CREATE_WINDOW;
     command.command.create_window.width = width;
     command.command.create_window.height = height;
-    memcpy(command.command.create_window.title, title, strlen(title));
+    strncpy(command.command.create_window.title, title, WR_WINDOW_TITLE_SIZE_MAX - 1);
+
+    return connection_queue_command(connection, command, NULL, 0);
+}
+
+uint32_t wr_submit_close_window(int serverfd, int id)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_CLOSE_WINDOW;
+    command.command.close_window.window_id = id;
+
+    return connection_queue_command(connection, command, NULL, 0);
+}
+
+uint32_t wr_submit_set_window_dma_buf(int serverfd, int window_id, WRDmaBuf dma_buf)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_SET_WINDOW_DMA_BUF;
+    command.command.set_window_dma_buf.window_id = window_id;
+    command.command.set_window_dma_buf.dma_buf = (WindowRendererDmaBuf) {
+        .width = dma_buf.width,
+        .height = dma_buf.height,
+        .format = dma_buf.format,
+        .stride = dma_buf.stride,
+    };
+
+    return connection_queue_command(connection, command, &dma_buf.fd, dma_buf.fd != -1 ? 1 : 0);
+}
+
+uint32_t wr_submit_set_window_buffer(int serverfd, int window_id, uint32_t buffer,
+                                     WRDmaBuf dma_buf)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_SET_WINDOW_BUFFER;
+    command.command.set_window_buffer.window_id = window_id;
+    command.command.set_window_buffer.buffer = buffer;
+    command.command.set_window_buffer.dma_buf = (WindowRendererDmaBuf) {
+        .width = dma_buf.width,
+        .height = dma_buf.height,
+        .format = dma_buf.format,
+        .stride = dma_buf.stride,
+    };
+
+    return connection_queue_command(connection, command, &dma_buf.fd, dma_buf.fd != -1 ? 1 : 0);
+}
+
+uint32_t wr_submit_commit_window(int serverfd, int window_id, uint32_t buffer,
+                                 int x, int y, int width, int height, int acquire_fence)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_COMMIT_WINDOW;
+    command.command.commit_window = (WindowRendererCommitWindow) {
+        .window_id = window_id,
+        .buffer = buffer,
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+    };
+
+    return connection_queue_command(connection, command,
+                                    &acquire_fence, acquire_fence != -1 ? 1 : 0);
+}
 
-    if (!send_command(serverfd, command, -1))
+uint32_t wr_submit_damage_window(int serverfd, int window_id,
+                                 int x, int y, int width, int height)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_DAMAGE_WINDOW;
+    command.command.damage_window = (WindowRendererDamageWindow) {
+        .window_id = window_id,
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+    };
+
+    return connection_queue_command(connection, command, NULL, 0);
+}
+
+uint32_t wr_submit_request_frame(int serverfd, int window_id)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return WR_REQUEST_ID_INVALID;
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_REQUEST_FRAME;
+    command.command.request_frame.window_id = window_id;
+
+    return connection_queue_command(connection, command, NULL, 0);
+}
+
+bool wr_flush(int serverfd)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return false;
+
+    bool result = true;
+
+    // A lone command is sent as is, anything more is sent in batches
+    if (connection->queued_count == 1) {
+        QueuedCommand* queued = &connection->queued[0];
+        result = send_commands(connection, &queued->command, 1,
+                               queued->fds, queued->command.fd_count);
+    } else {
+        WindowRendererCommand commands[WR_BATCH_COMMANDS_MAX + 1];
+        int fds[WR_BATCH_COMMANDS_MAX * WR_COMMAND_FDS_MAX];
+
+        for (size_t start = 0; start < connection->queued_count && result;
+             start += WR_BATCH_COMMANDS_MAX) {
+            size_t count = connection->queued_count - start;
+            if (count > WR_BATCH_COMMANDS_MAX)
+                count = WR_BATCH_COMMANDS_MAX;
+
+            memset(&commands[0], 0, sizeof(commands[0]));
+            commands[0].kind = WRCMD_BATCH;
+            commands[0].request_id = connection_next_request_id(connection);
+            commands[0].command.batch.count = count;
+
+            size_t fds_count = 0;
+            for (size_t i = 0; i < count; ++i) {
+                QueuedCommand* queued = &connection->queued[start + i];
+                commands[1 + i] = queued->command;
+                memcpy(&fds[fds_count], queued->fds, queued->command.fd_count * sizeof(*fds));
+                fds_count += queued->command.fd_count;
+            }
+
+            result = send_commands(connection, commands, count + 1, fds, fds_count);
+        }
+    }
+
+    connection->queued_count = 0;
+
+    return result;
+}
+
+bool wr_collect(int serverfd, uint32_t request_id, WindowRendererResponse* response)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return false;
+
+    if (connection->queued_count != 0 && !wr_flush(serverfd))
+        return false;
+
+    while (!connection_take_stashed_response(connection, request_id, response)) {
+        if (!recv_and_store_message(connection))
+            return false;
+    }
+
+    return true;
+}
+
+int wr_create_window(int serverfd, char const* title, int width, int height)
+{
+    uint32_t request_id = wr_submit_create_window(serverfd, title, width, height);
+    if (request_id == WR_REQUEST_ID_INVALID)
         return -1;
 
     WindowRendererResponse response;
-    if (!recv_response(serverfd, &response))
+    if (!wr_collect(serverfd, request_id, &response))
         return -1;
 
     if (!is_response_valid("create window", WRRESP_WINID, response))
@@ -170,15 +463,12 @@ int wr_create_window(int serverfd, char const* title, int width, int height)
 
 bool wr_close_window(int serverfd, int id)
 {
-    WindowRendererCommand command;
-    command.kind = WRCMD_CLOSE_WINDOW;
-    command.command.close_window.window_id = id;
-
-    if (!send_command(serverfd, command, -1))
+    uint32_t request_id = wr_submit_close_window(serverfd, id);
+    if (request_id == WR_REQUEST_ID_INVALID)
         return false;
 
     WindowRendererResponse response;
-    if (!recv_response(serverfd, &response))
+    if (!wr_collect(serverfd, request_id, &response))
         return false;
 
     if (!is_response_valid("close window", WRRESP_EMPTY, response))
@@ -189,21 +479,12 @@ bool wr_close_window(int serverfd, int id)
 
 bool wr_set_window_dma_buf(int serverfd, int window_id, WRDmaBuf dma_buf)
 {
-    WindowRendererCommand command;
-    command.kind = WRCMD_SET_WINDOW_DMA_BUF;
-    command.command.set_window_dma_buf.window_id = window_id;
-    command.command.set_window_dma_buf.dma_buf = (WindowRendererDmaBuf) {
-        .width = dma_buf.width,
-        .height = dma_buf.height,
-        .format = dma_buf.format,
-        .stride = dma_buf.stride,
-    };
-
-    if (!send_command(serverfd, command, dma_buf.fd))
+    uint32_t request_id = wr_submit_set_window_dma_buf(serverfd, window_id, dma_buf);
+    if (request_id == WR_REQUEST_ID_INVALID)
         return false;
 
     WindowRendererResponse response;
-    if (!recv_response(serverfd, &response))
+    if (!wr_collect(serverfd, request_id, &response))
         return false;
 
     if (!is_response_valid("set window DMA buffer", WRRESP_EMPTY, response))
@@ -212,40 +493,240 @@ bool wr_set_window_dma_buf(int serverfd, int window_id, WRDmaBuf dma_buf)
     return true;
 }
 
-int wr_event_connect(int window_id)
+bool wr_set_window_buffer(int serverfd, int window_id, uint32_t buffer, WRDmaBuf dma_buf)
 {
-    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        log_log(LOG_ERROR, "Could not open event socket: %s", strerror(errno));
-        return -1;
+    uint32_t request_id = wr_submit_set_window_buffer(serverfd, window_id, buffer, dma_buf);
+    if (request_id == WR_REQUEST_ID_INVALID)
+        return false;
+
+    WindowRendererResponse response;
+    if (!wr_collect(serverfd, request_id, &response))
+        return false;
+
+    if (!is_response_valid("set window buffer", WRRESP_EMPTY, response))
+        return false;
+
+    return true;
+}
+
+bool wr_commit_window(int serverfd, int window_id, uint32_t buffer,
+                      int x, int y, int width, int height, int acquire_fence)
+{
+    uint32_t request_id = wr_submit_commit_window(serverfd, window_id, buffer,
+                                                  x, y, width, height, acquire_fence);
+    if (request_id == WR_REQUEST_ID_INVALID)
+        return false;
+
+    WindowRendererResponse response;
+    if (!wr_collect(serverfd, request_id, &response))
+        return false;
+
+    if (!is_response_valid("commit window", WRRESP_EMPTY, response))
+        return false;
+
+    return true;
+}
+
+bool wr_damage_window(int serverfd, int window_id, int x, int y, int width, int height)
+{
+    uint32_t request_id = wr_submit_damage_window(serverfd, window_id, x, y, width, height);
+    if (request_id == WR_REQUEST_ID_INVALID)
+        return false;
+
+    WindowRendererResponse response;
+    if (!wr_collect(serverfd, request_id, &response))
+        return false;
+
+    if (!is_response_valid("damage window", WRRESP_EMPTY, response))
+        return false;
+
+    return true;
+}
+
+bool wr_request_frame(int serverfd, int window_id)
+{
+    uint32_t request_id = wr_submit_request_frame(serverfd, window_id);
+    if (request_id == WR_REQUEST_ID_INVALID)
+        return false;
+
+    WindowRendererResponse response;
+    if (!wr_collect(serverfd, request_id, &response))
+        return false;
+
+    if (!is_response_valid("request frame", WRRESP_EMPTY, response))
+        return false;
+
+    return true;
+}
+
+bool wr_event_ring_enable(int serverfd, uint32_t capacity)
+{
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return false;
+
+    if (connection->event_ring) {
+        log_log(LOG_ERROR, "The event ring is already enabled");
+        return false;
     }
 
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(struct sockaddr_un));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path,
-            server_session_generate_window_socket_name(window_id),
-            sizeof(addr.sun_path) - 1);
+    if (capacity == 0 || capacity > WR_EVENT_RING_CAPACITY_MAX
+        || (capacity & (capacity - 1)) != 0) {
+        log_log(LOG_ERROR, "Invalid event ring capacity %u", capacity);
+        return false;
+    }
 
-    if (connect(sockfd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) == -1) {
-        log_log(LOG_ERROR, "Could not connect to event socket: %s", strerror(errno));
-        close(sockfd);
-        return -1;
+    bool result = false;
+
+    WindowRendererEventRing* ring = MAP_FAILED;
+    size_t size = sizeof(WindowRendererEventRing) + capacity * sizeof(WindowRendererEvent);
+
+    int memfd = memfd_create("WindowRenderer event ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    int wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int space_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (memfd == -1 || wakeup_fd == -1 || space_fd == -1) {
+        log_log(LOG_ERROR, "Could not create event ring: %s", strerror(errno));
+        goto defer;
     }
 
-    return sockfd;
+    if (ftruncate(memfd, size) == -1
+        || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        log_log(LOG_ERROR, "Could not set up event ring memfd: %s", strerror(errno));
+        goto defer;
+    }
+
+    ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ring == MAP_FAILED) {
+        log_log(LOG_ERROR, "Could not map event ring: %s", strerror(errno));
+        goto defer;
+    }
+
+    WindowRendererCommand command;
+    memset(&command, 0, sizeof(command));
+    command.kind = WRCMD_SET_EVENT_RING;
+    command.command.set_event_ring.capacity = capacity;
+
+    int fds[] = { memfd, wakeup_fd, space_fd };
+    uint32_t request_id = connection_queue_command(connection, command, fds, 3);
+
+    // Events sent before the response are queued on the connection while
+    // waiting for it, everything after that goes through the ring
+    WindowRendererResponse response;
+    if (!wr_collect(serverfd, request_id, &response))
+        goto defer;
+
+    if (!is_response_valid("enable event ring", WRRESP_EMPTY, response))
+        goto defer;
+
+    connection->event_ring = ring;
+    connection->event_ring_size = size;
+    connection->event_ring_capacity = capacity;
+    connection->event_ring_wakeup_fd = wakeup_fd;
+    connection->event_ring_space_fd = space_fd;
+
+    result = true;
+
+defer:
+    if (memfd != -1)
+        close(memfd);
+    if (!result) {
+        if (ring != MAP_FAILED)
+            munmap(ring, size);
+        if (wakeup_fd != -1)
+            close(wakeup_fd);
+        if (space_fd != -1)
+            close(space_fd);
+    }
+    return result;
+}
+
+// Blocks until the server wrote to the ring or sent something on the
+// connection. Returns false on error
+static bool wait_for_ring_events(Connection* connection)
+{
+    WindowRendererEventRing* ring = connection->event_ring;
+
+    atomic_store_explicit(&ring->client_sleeping, 1, memory_order_relaxed);
+
+    // Either the server sees that we are sleeping, or we see the event it
+    // just wrote
+    atomic_thread_fence(memory_order_seq_cst);
+
+    bool result = true;
+
+    if (atomic_load_explicit(&ring->tail, memory_order_relaxed)
+        == atomic_load_explicit(&ring->head, memory_order_relaxed)) {
+        struct pollfd fds[] = {
+            { .fd = connection->event_ring_wakeup_fd, .events = POLLIN },
+            { .fd = connection->fd, .events = POLLIN },
+        };
+
+        while (poll(fds, 2, -1) == -1) {
+            if (errno != EINTR) {
+                log_log(LOG_ERROR, "Could not wait for events: %s", strerror(errno));
+                result = false;
+                goto defer;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            if (read(connection->event_ring_wakeup_fd, &value, sizeof(value)) == -1
+                && errno != EAGAIN)
+                log_log(LOG_WARNING, "Could not read event ring eventfd: %s",
+                        strerror(errno));
+        }
+
+        // Responses, or the connection being closed
+        if (fds[1].revents)
+            result = recv_and_store_message(connection);
+    }
+
+defer:
+    atomic_store_explicit(&ring->client_sleeping, 0, memory_order_relaxed);
+    return result;
 }
 
-bool wr_event_disconnect(int eventfd)
+bool wr_event_receive(int serverfd, WindowRendererEvent* event)
 {
-    if (close(eventfd) == -1) {
-        log_log(LOG_ERROR, "Failed to close event socket");
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
         return false;
+
+    while (!connection_take_queued_event(connection, event)
+           && !connection_take_ring_event(connection, event)) {
+        bool received = connection->event_ring
+            ? wait_for_ring_events(connection)
+            : recv_and_store_message(connection);
+
+        if (!received)
+            return false;
     }
+
     return true;
 }
 
-bool wr_event_receive(int eventfd, WindowRendererEvent* event)
+bool wr_event_poll(int serverfd, WindowRendererEvent* event)
 {
-    return recv_event(eventfd, event);
+    Connection* connection = get_connection(serverfd);
+    if (!connection)
+        return false;
+
+    if (connection_take_queued_event(connection, event)
+        || connection_take_ring_event(connection, event))
+        return true;
+
+    if (connection->event_ring)
+        return false;
+
+    while (true) {
+        if (store_received_messages(connection) == -1)
+            return false;
+
+        if (connection_take_queued_event(connection, event))
+            return true;
+
+        if (receive_bytes(connection, MSG_DONTWAIT) <= 0)
+            return false;
+    }
 }
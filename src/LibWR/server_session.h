@@ -5,4 +5,3 @@
 
 bool server_session_init();
 char* server_session_get_socket_name();
-char* server_session_generate_window_socket_name(int window_id);
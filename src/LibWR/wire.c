@@ -0,0 +1,200 @@
+#include "wire.h"
+
+#include <string.h>
+
+size_t wire_encode_command(unsigned char* data, WindowRendererCommand const* command)
+{
+    WindowRendererFrameHeader header = {
+        .size = sizeof(header),
+        .version = WR_PROTOCOL_VERSION,
+        .kind = command->kind,
+        .id = command->request_id,
+    };
+
+    unsigned char* payload = data + sizeof(header);
+
+    memcpy(payload, &command->fd_count, sizeof(command->fd_count));
+    payload += sizeof(command->fd_count);
+    header.size += sizeof(command->fd_count);
+
+    void const* member = NULL;
+    size_t member_size = 0;
+
+    switch (command->kind) {
+
+    case WRCMD_CREATE_WINDOW: {
+        WindowRendererCreateWindow const* create_window = &command->command.create_window;
+
+        size_t title_size = strnlen(create_window->title, WR_WINDOW_TITLE_SIZE_MAX - 1);
+
+        memcpy(payload, &create_window->width, sizeof(create_window->width));
+        payload += sizeof(create_window->width);
+        memcpy(payload, &create_window->height, sizeof(create_window->height));
+        payload += sizeof(create_window->height);
+        memcpy(payload, create_window->title, title_size);
+
+        header.size += sizeof(create_window->width) + sizeof(create_window->height) + title_size;
+        break;
+    }
+
+    case WRCMD_CLOSE_WINDOW:
+        member = &command->command.close_window;
+        member_size = sizeof(command->command.close_window);
+        break;
+
+    case WRCMD_SET_WINDOW_DMA_BUF:
+        member = &command->command.set_window_dma_buf;
+        member_size = sizeof(command->command.set_window_dma_buf);
+        break;
+
+    case WRCMD_BATCH:
+        member = &command->command.batch;
+        member_size = sizeof(command->command.batch);
+        break;
+
+    case WRCMD_SET_EVENT_RING:
+        member = &command->command.set_event_ring;
+        member_size = sizeof(command->command.set_event_ring);
+        break;
+
+    case WRCMD_DAMAGE_WINDOW:
+        member = &command->command.damage_window;
+        member_size = sizeof(command->command.damage_window);
+        break;
+
+    case WRCMD_REQUEST_FRAME:
+        member = &command->command.request_frame;
+        member_size = sizeof(command->command.request_frame);
+        break;
+
+    case WRCMD_SET_WINDOW_BUFFER:
+        member = &command->command.set_window_buffer;
+        member_size = sizeof(command->command.set_window_buffer);
+        break;
+
+    case WRCMD_COMMIT_WINDOW:
+        member = &command->command.commit_window;
+        member_size = sizeof(command->command.commit_window);
+        break;
+    }
+
+    if (member_size != 0) {
+        memcpy(payload, member, member_size);
+        header.size += member_size;
+    }
+
+    memcpy(data, &header, sizeof(header));
+    return header.size;
+}
+
+static bool decode_response(unsigned char const* payload, size_t payload_size,
+                            WindowRendererResponse* response)
+{
+    size_t prefix_size = sizeof(response->kind) + sizeof(response->status);
+    if (payload_size < prefix_size)
+        return false;
+
+    memcpy(&response->kind, payload, sizeof(response->kind));
+    memcpy(&response->status, payload + sizeof(response->kind), sizeof(response->status));
+
+    void* member = NULL;
+    size_t member_size = 0;
+
+    switch (response->kind) {
+    case WRRESP_WINID:
+        member = &response->response.window_id;
+        member_size = sizeof(response->response.window_id);
+        break;
+
+    case WRRESP_BATCH:
+        member = &response->response.batch;
+        member_size = sizeof(response->response.batch);
+        break;
+
+    case WRRESP_EMPTY:
+        break;
+
+    default:
+        return false;
+    }
+
+    if (payload_size != prefix_size + member_size)
+        return false;
+
+    if (member_size != 0)
+        memcpy(member, payload + prefix_size, member_size);
+    return true;
+}
+
+static bool decode_event(unsigned char const* payload, size_t payload_size,
+                         WindowRendererEvent* event)
+{
+    size_t prefix_size = sizeof(event->kind);
+    if (payload_size < prefix_size)
+        return false;
+
+    memcpy(&event->kind, payload, sizeof(event->kind));
+
+    void* member = NULL;
+    size_t member_size = 0;
+
+    switch (event->kind) {
+    case WREVENT_MOUSE_BUTTON:
+        member = &event->event.mouse_button;
+        member_size = sizeof(event->event.mouse_button);
+        break;
+
+    case WREVENT_MOUSE_MOVE:
+        member = &event->event.mouse_move;
+        member_size = sizeof(event->event.mouse_move);
+        break;
+
+    case WREVENT_FRAME_DONE:
+        member = &event->event.frame_done;
+        member_size = sizeof(event->event.frame_done);
+        break;
+
+    case WREVENT_BUFFER_RELEASE:
+        member = &event->event.buffer_release;
+        member_size = sizeof(event->event.buffer_release);
+        break;
+
+    case WREVENT_CLOSE_WINDOW:
+        break;
+
+    default:
+        return false;
+    }
+
+    if (payload_size != prefix_size + member_size)
+        return false;
+
+    if (member_size != 0)
+        memcpy(member, payload + prefix_size, member_size);
+    return true;
+}
+
+bool wire_decode_message(unsigned char const* data, WindowRendererMessage* message)
+{
+    WindowRendererFrameHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    memset(message, 0, sizeof(*message));
+    message->kind = header.kind;
+
+    unsigned char const* payload = data + sizeof(header);
+    size_t payload_size = header.size - sizeof(header);
+
+    switch (message->kind) {
+    case WRMSG_RESPONSE:
+        message->message.response.request_id = header.id;
+        return decode_response(payload, payload_size, &message->message.response);
+
+    case WRMSG_EVENT:
+        message->message.event.window_id = header.id;
+        return decode_event(payload, payload_size, &message->message.event);
+
+    default:
+        return false;
+    }
+}
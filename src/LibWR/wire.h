@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "WindowRenderer/windowrenderer.h"
+
+// Big enough for any command frame the client sends
+#define WIRE_COMMAND_SIZE_MAX (sizeof(WindowRendererFrameHeader) + sizeof(WindowRendererCommand))
+
+// Returns the size of the frame written to `data`, which must have room
+// for WIRE_COMMAND_SIZE_MAX bytes
+size_t wire_encode_command(unsigned char* data, WindowRendererCommand const* command);
+
+// Decodes a whole frame, as checked by `wr_check_frame`. Returns false
+// if it isn't a message, or its payload doesn't match its kind
+bool wire_decode_message(unsigned char const* data, WindowRendererMessage* message);
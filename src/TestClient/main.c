@@ -76,14 +76,20 @@ int main(int argc, char const** argv)
 
     glFlush();
 
-    int eventfd = wr_event_connect(window_id);
-    if (eventfd == -1) {
+    // The server only redraws windows that say they changed. The frame
+    // request tells when that content was shown
+    if (!wr_damage_window(serverfd, window_id, 0, 0, width, height)
+        || !wr_request_frame(serverfd, window_id)) {
+        wrgl_context_destroy(wrgl_context);
+        wrgl_buffer_destroy(wrgl_buffer);
+        wr_close_window(serverfd, window_id);
+        wr_server_disconnect(serverfd);
         return 1;
     }
 
     while (true) {
         WindowRendererEvent event;
-        if (!wr_event_receive(eventfd, &event)) {
+        if (!wr_event_receive(serverfd, &event)) {
             return 1;
         }
 
@@ -116,16 +122,19 @@ int main(int argc, char const** argv)
             }
         }
 
+        if (event.kind == WREVENT_FRAME_DONE) {
+            log_log(LOG_INFO, "Frame %llu shown at %llu ns, next one in %llu ns",
+                    (unsigned long long)event.event.frame_done.sequence,
+                    (unsigned long long)event.event.frame_done.presentation_time,
+                    (unsigned long long)event.event.frame_done.refresh_interval);
+        }
+
         if (event.kind == WREVENT_MOUSE_MOVE) {
             log_log(LOG_INFO, "Mouse moved. Current position: { %d, %d }",
                     event.event.mouse_move.position_x, event.event.mouse_move.position_y);
         }
     }
 
-    if (!wr_event_disconnect(eventfd)) {
-        return 1;
-    }
-
     wrgl_context_destroy(wrgl_context);
     wrgl_buffer_destroy(wrgl_buffer);
 
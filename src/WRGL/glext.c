@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -16,6 +17,9 @@ PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = NULL;
 PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR = NULL;
 PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR = NULL;
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = NULL;
+PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR = NULL;
+PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR = NULL;
+PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID = NULL;
 
 #define LOAD_PROC(name)                                                           \
     do {                                                                          \
@@ -43,3 +47,40 @@ bool glext_load_extensions()
 }
 
 #undef LOAD_PROC
+
+static bool has_extension(const char* extensions, const char* name)
+{
+    if (!extensions)
+        return false;
+
+    size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+        if ((found == extensions || found[-1] == ' ')
+            && (found[length] == ' ' || found[length] == '\0'))
+            return true;
+    }
+
+    return false;
+}
+
+// eglGetProcAddress may return stubs for functions the driver doesn't
+// implement, so the extension has to be advertised as well
+bool glext_load_native_fence_sync(EGLDisplay egl_display)
+{
+    const char* extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_ANDROID_native_fence_sync"))
+        return false;
+
+    eglCreateSyncKHR = (typeof(eglCreateSyncKHR))eglGetProcAddress("eglCreateSyncKHR");
+    eglDestroySyncKHR = (typeof(eglDestroySyncKHR))eglGetProcAddress("eglDestroySyncKHR");
+    eglDupNativeFenceFDANDROID
+        = (typeof(eglDupNativeFenceFDANDROID))eglGetProcAddress("eglDupNativeFenceFDANDROID");
+
+    if (!eglCreateSyncKHR || !eglDestroySyncKHR || !eglDupNativeFenceFDANDROID) {
+        log_log(LOG_WARNING, "Native fence sync is advertised, but its functions "
+                             "could not be loaded");
+        return false;
+    }
+
+    return true;
+}
@@ -12,4 +12,11 @@ extern PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 extern PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 extern PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 
+// Optional, only loaded by `glext_load_native_fence_sync`
+extern PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+extern PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+extern PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
+
 bool glext_load_extensions();
+// Returns false if `egl_display` doesn't support native fence sync
+bool glext_load_native_fence_sync(EGLDisplay egl_display);
@@ -47,8 +47,19 @@ typedef struct {
     GLuint gl_texture;
     GLuint gl_framebuffer_object;
     GLuint gl_renderbuffer_object;
+
+    // Whether `wrgl_context_create_fence` can create fences
+    bool native_fence_sync;
 } WRGLContext;
 
 WRGLContext* wrgl_context_create_for_buffer(WRGLBuffer* wrgl_buffer,
                                             WRGLContextParameters context_parameters);
 void wrgl_context_destroy(WRGLContext* wrgl_context);
+
+/*
+ * Returns a sync_file fence signaled once the commands issued so far are
+ * done, to be passed to `wr_commit_window`. The caller owns it. Returns
+ * -1 if fences aren't supported, in which case call `glFinish` before
+ * committing instead.
+ */
+int wrgl_context_create_fence(WRGLContext* wrgl_context);
@@ -108,6 +108,8 @@ WRGLContext* wrgl_context_create_for_buffer(WRGLBuffer* wrgl_buffer,
         goto defer;
     }
 
+    wrgl_context->native_fence_sync = glext_load_native_fence_sync(wrgl_context->egl_display);
+
     EGLenum opengl_api;
     if (context_parameters.api_conformance == WRGL_API_OPENGL_ES_1
         || context_parameters.api_conformance == WRGL_API_OPENGL_ES_2
@@ -316,3 +318,35 @@ void wrgl_context_destroy(WRGLContext* wrgl_context)
 
     free(wrgl_context);
 }
+
+int wrgl_context_create_fence(WRGLContext* wrgl_context)
+{
+    if (!wrgl_context->native_fence_sync)
+        return -1;
+
+    // The fence and the flush apply to the current context
+    if (eglGetCurrentContext() != wrgl_context->egl_context)
+        eglMakeCurrent(wrgl_context->egl_display,
+                       EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       wrgl_context->egl_context);
+
+    EGLSyncKHR sync = eglCreateSyncKHR(wrgl_context->egl_display,
+                                       EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+    if (sync == EGL_NO_SYNC_KHR) {
+        log_log(LOG_ERROR, "Failed to create native fence sync");
+        return -1;
+    }
+
+    // The fence only gets a file descriptor once it's flushed
+    glFlush();
+
+    int fence = eglDupNativeFenceFDANDROID(wrgl_context->egl_display, sync);
+    eglDestroySyncKHR(wrgl_context->egl_display, sync);
+
+    if (fence == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+        log_log(LOG_ERROR, "Failed to get file descriptor of native fence");
+        return -1;
+    }
+
+    return fence;
+}
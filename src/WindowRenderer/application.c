@@ -8,13 +8,19 @@
 #include "renderer/renderer.h"
 #include "server/server.h"
 #include "server/session.h"
+#include "trace.h"
 #include "window_manager.h"
 
+#include <SRMConnectorMode.h>
+
 #include <errno.h>
+#include <math.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 static bool execute_command(int argc, char const** argv, int delay)
@@ -47,20 +53,116 @@ static bool execute_command(int argc, char const** argv, int delay)
     return true;
 }
 
+// Font titles are drawn with, unless another one is set in this
+// environment variable
+#define TITLE_FONT_ENV "WINDOW_RENDERER_TITLE_FONT"
+#define TITLE_FONT_DEFAULT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+#define TITLE_PIXEL_SIZE 14
+// Space between the title and the ends of the title bar
+#define TITLE_PADDING 4.0f
+
+// The cursor is drawn as a square of this size
+static const Vector2 cursor_size = { 5, 5 };
+
 struct {
     Server* server;
+
+    pthread_mutex_t outputs_mutex;
+    Output** outputs;
+    size_t outputs_count;
+    size_t outputs_capacity;
+
+    // The window stack, cursor position and input serial damage was last
+    // computed for. Only accessed from the main thread
+    WindowStack* damage_stack;
+    Vector2 damage_cursor_position;
+    uint64_t damage_input_serial;
+    // Waiting to be handed to the outputs along with the damage of their
+    // windows. Only accessed from the main thread
+    PresentWaiters present_waiters;
+
+    // Added to by the outputs when frames are presented. Window events
+    // are only sent from the main thread, so they're sent from there
+    pthread_mutex_t presented_mutex;
+    PresentWaiters presented_waiters;
+    // Written when `presented_waiters` stops being empty
+    int presented_fd;
+    // Swapped with `presented_waiters` by the main thread, so events
+    // aren't sent with the mutex held
+    PresentWaiters sent_waiters;
 } APP;
 
+static PresentWaiter* present_waiter_create(Window* window, WindowRendererEvent event)
+{
+    PresentWaiter* waiter = malloc(sizeof(*waiter));
+    memset(waiter, 0, sizeof(*waiter));
+
+    window_ref(window);
+    waiter->window = window;
+    waiter->event = event;
+
+    return waiter;
+}
+
+static void present_waiter_destroy(PresentWaiter* waiter)
+{
+    window_unref(waiter->window);
+    free(waiter);
+}
+
+// Sends the waiter's event and destroys it. Called from the main thread
+static void present_waiter_finish(PresentWaiter* waiter)
+{
+    // Before the client hears about it, so that it can commit the buffer
+    // again right away
+    if (waiter->event.kind == WREVENT_BUFFER_RELEASE)
+        window_release_buffers(waiter->window, 1u << waiter->event.event.buffer_release.buffer);
+
+    window_send_event(waiter->window, waiter->event);
+    present_waiter_destroy(waiter);
+}
+
+static void present_waiters_push(PresentWaiters* waiters, PresentWaiter* waiter)
+{
+    if (waiters->waiters_count == waiters->waiters_capacity) {
+        waiters->waiters_capacity = waiters->waiters_capacity == 0
+            ? 8
+            : waiters->waiters_capacity * 2;
+        waiters->waiters = realloc(waiters->waiters,
+                                   waiters->waiters_capacity * sizeof(*waiters->waiters));
+    }
+    waiters->waiters[waiters->waiters_count++] = waiter;
+}
+
+// Moves the waiters of `source` to the end of `destination`
+static void present_waiters_move(PresentWaiters* destination, PresentWaiters* source)
+{
+    for (size_t i = 0; i < source->waiters_count; ++i) {
+        present_waiters_push(destination, source->waiters[i]);
+    }
+    source->waiters_count = 0;
+}
+
 bool application_init(int argc, char const** argv)
 {
     memset(&APP, 0, sizeof(APP));
+    pthread_mutex_init(&APP.outputs_mutex, NULL);
+    pthread_mutex_init(&APP.presented_mutex, NULL);
+
+    APP.presented_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (APP.presented_fd == -1) {
+        log_log(LOG_ERROR, "Could not create frame presentation eventfd: %s",
+                strerror(errno));
+        return false;
+    }
 
     // Get real UID and GID
     uid_t real_uid = getuid();
     gid_t real_gid = getgid();
 
     // Setup listening for mouse/keyboard events
-    input_start_processing();
+    if (!input_start_processing())
+        return false;
 
     // Set effective UID and GID to the real ones
     if (seteuid(real_uid) == -1) {
@@ -108,107 +210,632 @@ bool application_init(int argc, char const** argv)
 
 void application_terminate()
 {
+    if (APP.damage_stack)
+        window_stack_unref(APP.damage_stack);
+
+    // The outputs are gone, so every waiter is in one of these
+    for (size_t i = 0; i < APP.present_waiters.waiters_count; ++i) {
+        present_waiter_destroy(APP.present_waiters.waiters[i]);
+    }
+    for (size_t i = 0; i < APP.presented_waiters.waiters_count; ++i) {
+        present_waiter_destroy(APP.presented_waiters.waiters[i]);
+    }
+    free(APP.present_waiters.waiters);
+    free(APP.presented_waiters.waiters);
+    free(APP.sent_waiters.waiters);
+    pthread_mutex_destroy(&APP.presented_mutex);
+    close(APP.presented_fd);
+
     server_destroy(APP.server);
+
+    free(APP.outputs);
+    pthread_mutex_destroy(&APP.outputs_mutex);
+}
+
+// `input_serial` is that of the newest input `damage` shows, 0 if none
+static void output_add_damage(Output* output, Damage damage, uint64_t input_serial)
+{
+    pthread_mutex_lock(&output->damage_mutex);
+    damage_add(&output->damage, damage);
+    if (input_serial != 0)
+        output->damage_input_serial = input_serial;
+    pthread_mutex_unlock(&output->damage_mutex);
+
+    srmConnectorRepaint(output->connector);
+}
+
+// Every output shows the same screen, so all of them get the damage
+static void application_add_damage(Damage damage, uint64_t input_serial)
+{
+    pthread_mutex_lock(&APP.outputs_mutex);
+
+    for (size_t i = 0; i < APP.outputs_count; ++i) {
+        output_add_damage(APP.outputs[i], damage, input_serial);
+    }
+
+    pthread_mutex_unlock(&APP.outputs_mutex);
+}
+
+// Called when an output presented the frame that took `waiters`. Those
+// no other output has to present a frame for go to the main thread
+static void application_waiters_presented(PresentWaiters* waiters,
+                                          WindowRendererFrameDone frame_done)
+{
+    if (waiters->waiters_count == 0)
+        return;
+
+    pthread_mutex_lock(&APP.presented_mutex);
+
+    bool was_empty = APP.presented_waiters.waiters_count == 0;
+
+    for (size_t i = 0; i < waiters->waiters_count; ++i) {
+        PresentWaiter* waiter = waiters->waiters[i];
+
+        // Only ever waits for a single output
+        if (waiter->event.kind == WREVENT_FRAME_DONE)
+            waiter->event.event.frame_done = frame_done;
+
+        if (atomic_fetch_sub(&waiter->outputs_left, 1) == 1)
+            present_waiters_push(&APP.presented_waiters, waiter);
+    }
+    waiters->waiters_count = 0;
+
+    bool is_empty = APP.presented_waiters.waiters_count == 0;
+
+    pthread_mutex_unlock(&APP.presented_mutex);
+
+    // Otherwise the main thread was already woken up and hasn't taken
+    // the waiters yet
+    if (was_empty && !is_empty) {
+        uint64_t value = 1;
+        if (write(APP.presented_fd, &value, sizeof(value)) == -1)
+            log_log(LOG_WARNING, "Could not signal presented frame: %s", strerror(errno));
+    }
 }
 
-void application_init_graphics(Renderer* renderer)
+Output* application_create_output(SRMConnector* connector, Renderer* renderer,
+                                  EGLDisplay* egl_display)
 {
     input_set_cursor_bounds(renderer_get_screen_size(renderer));
+
+    Output* output = malloc(sizeof(*output));
+    memset(output, 0, sizeof(*output));
+
+    output->connector = connector;
+    output->renderer = renderer;
+    output->dma_buf_cache = dma_buf_cache_create(egl_display);
+
+    const char* font_path = getenv(TITLE_FONT_ENV);
+    if (!font_path)
+        font_path = TITLE_FONT_DEFAULT;
+
+    output->glyph_atlas = glyph_atlas_create(font_path);
+    if (output->glyph_atlas) {
+        output->title_cache = title_cache_create(output->glyph_atlas, TITLE_PIXEL_SIZE);
+    } else {
+        log_log(LOG_WARNING, "Window titles won't be drawn. Set %s to the path of "
+                             "another font to draw them",
+                TITLE_FONT_ENV);
+    }
+
+    region_init(&output->visible_region);
+    region_init(&output->covered_region);
+    region_init(&output->visible_rects);
+
+    // Nothing was drawn on any of the buffers yet
+    Damage screen = damage_empty();
+    damage_add_rect(&screen, (Vector2) { 0, 0 }, renderer_get_screen_size(renderer));
+
+    pthread_mutex_init(&output->damage_mutex, NULL);
+    output->damage = screen;
+    for (size_t i = 0; i < OUTPUT_BUFFERS_MAX - 1; ++i) {
+        output->previous_damage[i] = screen;
+    }
+
+    pthread_mutex_lock(&APP.outputs_mutex);
+
+    if (APP.outputs_count == APP.outputs_capacity) {
+        APP.outputs_capacity = APP.outputs_capacity == 0 ? 4 : APP.outputs_capacity * 2;
+        APP.outputs = realloc(APP.outputs, APP.outputs_capacity * sizeof(*APP.outputs));
+    }
+    APP.outputs[APP.outputs_count++] = output;
+
+    pthread_mutex_unlock(&APP.outputs_mutex);
+
+    return output;
 }
 
-static void draw_window(Renderer* renderer, EGLDisplay* egl_display, Window* window)
+void application_destroy_output(Output* output)
 {
-    WMWindowParameters window_parameters = wm_compute_window_parameters(window);
+    pthread_mutex_lock(&APP.outputs_mutex);
 
-    // Draw window border
-    renderer_draw_rectangle(renderer,
-                            window_parameters.border_position,
-                            window_parameters.border_size,
-                            (Vector4) { 0.0f, 0.0f, 1.0f, 1.0f });
+    for (size_t i = 0; i < APP.outputs_count; ++i) {
+        if (APP.outputs[i] == output) {
+            APP.outputs[i] = APP.outputs[--APP.outputs_count];
+            break;
+        }
+    }
 
-    // Draw title bar
-    renderer_draw_rectangle(renderer,
-                            window_parameters.title_bar_position,
-                            window_parameters.title_bar_size,
-                            (Vector4) { 1.0f, 1.0f, 0.0f, 1.0f });
+    pthread_mutex_unlock(&APP.outputs_mutex);
+
+    pthread_mutex_destroy(&output->damage_mutex);
+
+    // The output won't read from buffers anymore, and won't present
+    // frames either
+    application_waiters_presented(&output->present_waiters, (WindowRendererFrameDone) { 0 });
+    application_waiters_presented(&output->drawn_present_waiters, (WindowRendererFrameDone) { 0 });
+    free(output->present_waiters.waiters);
+    free(output->drawn_present_waiters.waiters);
+    region_destroy(&output->visible_region);
+    region_destroy(&output->covered_region);
+    region_destroy(&output->visible_rects);
+    free(output->visible_windows);
+    dma_buf_cache_destroy(output->dma_buf_cache);
+    if (output->title_cache)
+        title_cache_destroy(output->title_cache);
+    if (output->glyph_atlas)
+        glyph_atlas_destroy(output->glyph_atlas);
+    renderer_destroy(output->renderer);
+    free(output);
+}
 
-    // Draw close button
-    renderer_draw_rectangle(renderer,
-                            window_parameters.close_button_position,
-                            window_parameters.close_button_size,
-                            (Vector4) { 1.0, 0.0f, 0.0f, 1.0f });
+void application_damage_output(Output* output)
+{
+    Damage screen = damage_empty();
+    damage_add_rect(&screen, (Vector2) { 0, 0 }, renderer_get_screen_size(output->renderer));
 
-    // Draw window content
-    {
-        Vector2 window_content_size = { window->width, window->height };
+    output_add_damage(output, screen, 0);
+}
+
+static void set_crop(Renderer* renderer, RegionRect rect)
+{
+    renderer_set_crop(renderer,
+                      (Vector2) { rect.x0, rect.y0 },
+                      (Vector2) { rect.x1 - rect.x0, rect.y1 - rect.y0 });
+}
 
+// Draws the decorations of the window, and its content when the client
+// didn't set a buffer yet
+static void draw_window_frame(Output* output, VisibleWindow* visible_window)
+{
+    Renderer* renderer = output->renderer;
+    WMWindowParameters* window_parameters = &visible_window->parameters;
+    Window* window = visible_window->window;
+
+    for (size_t i = visible_window->rects_begin; i < visible_window->rects_end; ++i) {
+        set_crop(renderer, output->visible_rects.rects[i]);
+
+        // Draw window border
         renderer_draw_rectangle(renderer,
-                                window_parameters.content_position,
-                                window_content_size,
-                                (Vector4) { 1.0f, 1.0f, 1.0f, 1.0f });
-
-        if (window->dma_buf.present) {
-            EGLint image_attrs[] = {
-                EGL_WIDTH, window->dma_buf.width,
-                EGL_HEIGHT, window->dma_buf.height,
-                EGL_LINUX_DRM_FOURCC_EXT, window->dma_buf.format,
-                EGL_DMA_BUF_PLANE0_FD_EXT, window->dma_buf.fd,
-                EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                EGL_DMA_BUF_PLANE0_PITCH_EXT, window->dma_buf.stride,
-                EGL_NONE
-            };
+                                window_parameters->border_position,
+                                window_parameters->border_size,
+                                (Vector4) { 0.0f, 0.0f, 1.0f, 1.0f });
 
-            EGLImageKHR egl_image = eglCreateImageKHR(egl_display, EGL_NO_CONTEXT,
-                                                      EGL_LINUX_DMA_BUF_EXT,
-                                                      NULL,
-                                                      image_attrs);
-            if (egl_image == EGL_NO_IMAGE_KHR) {
-                log_log(LOG_ERROR, "Could not create EGL image from DMA buffer");
-                return;
-            }
+        // Draw title bar
+        renderer_draw_rectangle(renderer,
+                                window_parameters->title_bar_position,
+                                window_parameters->title_bar_size,
+                                (Vector4) { 1.0f, 1.0f, 0.0f, 1.0f });
 
-            Texture* texture = texture_create_from_egl_imagekhr(egl_image,
-                                                                window->dma_buf.width,
-                                                                window->dma_buf.height);
+        // Draw close button
+        renderer_draw_rectangle(renderer,
+                                window_parameters->close_button_position,
+                                window_parameters->close_button_size,
+                                (Vector4) { 1.0, 0.0f, 0.0f, 1.0f });
+
+        if (!visible_window->texture) {
+            renderer_draw_rectangle(renderer,
+                                    window_parameters->content_position,
+                                    (Vector2) { window->width, window->height },
+                                    (Vector4) { 1.0f, 1.0f, 1.0f, 1.0f });
+        }
+    }
+}
+
+static void draw_window_title(Output* output, VisibleWindow* visible_window)
+{
+    Renderer* renderer = output->renderer;
+    WMWindowParameters* window_parameters = &visible_window->parameters;
+    Text* title = visible_window->title;
 
-            renderer_draw_texture_ex(renderer,
-                                     texture,
-                                     window_parameters.content_position,
-                                     window_content_size,
-                                     (Vector4) { 1.0f, 1.0f, 1.0f, 1.0f });
+    Vector2 title_position = {
+        window_parameters->title_bar_position.x + TITLE_PADDING,
+        window_parameters->title_bar_position.y
+            + roundf((window_parameters->title_bar_size.y - title->size.y) / 2.0f),
+    };
+
+    for (size_t i = visible_window->rects_begin; i < visible_window->rects_end; ++i) {
+        set_crop(renderer, output->visible_rects.rects[i]);
+
+        renderer_draw_text(renderer, title, title_position,
+                           (Vector4) { 0.0f, 0.0f, 0.0f, 1.0f });
+    }
+}
+
+static void draw_window_content(Output* output, VisibleWindow* visible_window)
+{
+    Renderer* renderer = output->renderer;
+    Window* window = visible_window->window;
 
-            texture_destroy(texture);
+    for (size_t i = visible_window->rects_begin; i < visible_window->rects_end; ++i) {
+        set_crop(renderer, output->visible_rects.rects[i]);
 
-            eglDestroyImageKHR(egl_display, egl_image);
+        renderer_draw_texture_ex(renderer,
+                                 visible_window->texture,
+                                 visible_window->parameters.content_position,
+                                 (Vector2) { window->width, window->height },
+                                 (Vector4) { 1.0f, 1.0f, 1.0f, 1.0f });
+    }
+}
+
+/*
+ * Windows are opaque, so nothing below a window shows through it. Going
+ * front to back, each one is only drawn where no window above covers it
+ * and inside the damage, so windows buried under others cost nothing.
+ *
+ * What's drawn of each window never overlaps the others, so the order
+ * doesn't matter anymore: the frames of all windows are drawn first, in
+ * a single batch, then all titles, from the glyph atlas, then each
+ * content texture.
+ */
+static void draw_windows(Output* output, WindowStack* stack, Damage damage)
+{
+    Region* visible = &output->visible_region;
+    Region* covered = &output->covered_region;
+
+    RegionRect damage_rect = { damage.x0, damage.y0, damage.x1, damage.y1 };
+    region_clear(covered);
+    region_clear(&output->visible_rects);
+    output->visible_windows_count = 0;
+
+    for (size_t i = stack->windows_count; i-- > 0;) {
+        Window* window = stack->windows[i];
+
+        // Computed once, so the window is drawn where it was found visible
+        // even if it's being moved
+        WMWindowParameters window_parameters = wm_compute_window_parameters(window);
+        RegionRect area = region_rect_make(window_parameters.total_area_position,
+                                           window_parameters.total_area_size);
+
+        region_clear(visible);
+        region_add_rect(visible, region_rect_intersect(area, damage_rect));
+
+        for (size_t j = 0; j < covered->rects_count && visible->rects_count > 0; ++j) {
+            region_subtract_rect(visible, covered->rects[j]);
+        }
+
+        region_add_rect(covered, area);
+
+        if (visible->rects_count == 0)
+            continue;
+
+        if (output->visible_windows_count == output->visible_windows_capacity) {
+            output->visible_windows_capacity = output->visible_windows_capacity == 0
+                ? 16
+                : output->visible_windows_capacity * 2;
+            output->visible_windows = realloc(output->visible_windows,
+                                              output->visible_windows_capacity
+                                                  * sizeof(*output->visible_windows));
         }
+
+        VisibleWindow* visible_window = &output->visible_windows[output->visible_windows_count++];
+        visible_window->window = window;
+        visible_window->parameters = window_parameters;
+        // Only imported again when the client sets a new buffer
+        visible_window->texture = dma_buf_cache_get(output->dma_buf_cache, i, window);
+        visible_window->title = NULL;
+        if (output->title_cache) {
+            float max_width = window_parameters.title_bar_size.x - TITLE_PADDING * 2.0f;
+            visible_window->title = title_cache_get(output->title_cache, i, window, max_width);
+        }
+        visible_window->rects_begin = output->visible_rects.rects_count;
+
+        for (size_t j = 0; j < visible->rects_count; ++j) {
+            region_add_rect(&output->visible_rects, visible->rects[j]);
+        }
+
+        visible_window->rects_end = output->visible_rects.rects_count;
+    }
+
+    for (size_t i = 0; i < output->visible_windows_count; ++i) {
+        draw_window_frame(output, &output->visible_windows[i]);
+    }
+
+    if (output->title_cache) {
+        renderer_set_blending(output->renderer, true);
+
+        for (size_t i = 0; i < output->visible_windows_count; ++i) {
+            draw_window_title(output, &output->visible_windows[i]);
+        }
+
+        renderer_set_blending(output->renderer, false);
     }
+
+    for (size_t i = 0; i < output->visible_windows_count; ++i) {
+        if (output->visible_windows[i].texture)
+            draw_window_content(output, &output->visible_windows[i]);
+    }
+
+    renderer_reset_crop(output->renderer);
 }
 
-void application_render(Renderer* renderer, EGLDisplay* egl_display)
+void application_render(Output* output)
 {
-    (void)egl_display;
+    Renderer* renderer = output->renderer;
+    uint64_t trace_begin = trace_now();
+
+    pthread_mutex_lock(&output->damage_mutex);
+    Damage new_damage = output->damage;
+    output->damage = damage_empty();
+    uint64_t input_serial = output->damage_input_serial;
+    output->damage_input_serial = 0;
+    // Taken along with the damage of their windows, so the frame shows
+    // what they wait for. Even with nothing to draw, the frame is still
+    // presented
+    present_waiters_move(&output->drawn_present_waiters, &output->present_waiters);
+    pthread_mutex_unlock(&output->damage_mutex);
+
+    Damage damage = new_damage;
+    for (size_t i = 0; i < OUTPUT_BUFFERS_MAX - 1; ++i) {
+        damage_add(&damage, output->previous_damage[i]);
+    }
+
+    memmove(&output->previous_damage[1], &output->previous_damage[0],
+            (OUTPUT_BUFFERS_MAX - 2) * sizeof(*output->previous_damage));
+    output->previous_damage[0] = new_damage;
+
+    output->drawn_input_serial = input_serial;
+    output->rendered_at = trace_begin;
+
+    // Every buffer already shows what's current
+    damage = damage_clip(damage, renderer_get_screen_size(renderer));
+    if (damage_is_empty(damage))
+        return;
+
+    renderer_begin_drawing(renderer);
+    renderer_set_clip(renderer,
+                      (Vector2) { damage.x0, damage.y0 },
+                      (Vector2) { damage.x1 - damage.x0, damage.y1 - damage.y0 });
 
     gl(ClearColor, 0.8f, 0.8f, 0.8f, 1.0f);
     gl(Clear, GL_COLOR_BUFFER_BIT);
 
-    renderer_begin_drawing(renderer);
+    // Client commands keep being handled while the frame is drawn. They
+    // only show up in the next one
+    WindowStack* stack = server_acquire_windows(APP.server);
+    dma_buf_cache_sync(output->dma_buf_cache, stack);
+    if (output->title_cache)
+        title_cache_sync(output->title_cache, stack);
 
-    server_lock_windows(APP.server);
+    draw_windows(output, stack, damage);
 
-    for (size_t i = 0; i < server_get_window_count(APP.server); ++i) {
-        Window* window = server_get_windows(APP.server)[i];
-        draw_window(renderer, egl_display, window);
-    }
+    window_stack_unref(stack);
+    dma_buf_cache_report(output->dma_buf_cache);
 
     renderer_draw_rectangle(renderer,
-                            get_cursor_position(), (Vector2) { 5, 5 },
+                            get_cursor_position(), cursor_size,
                             (Vector4) { 0.0f, 1.0f, 0.0f, 1.0f });
 
-    server_unlock_windows(APP.server);
+    renderer_reset_clip(renderer);
+    renderer_end_drawing(renderer);
+
+    output->rendered_at = trace_now();
+    trace_record(TRACE_RENDER, trace_begin, output->rendered_at, input_serial);
+}
+
+void application_output_presented(Output* output)
+{
+    trace_record(TRACE_PAGE_FLIP, output->rendered_at, trace_now(),
+                 output->drawn_input_serial);
+
+    if (output->drawn_present_waiters.waiters_count == 0)
+        return;
+
+    WindowRendererFrameDone frame_done = { 0 };
+
+    const SRMPresentationTime* presentation_time
+        = srmConnectorGetPresentationTime(output->connector);
+    if (presentation_time) {
+        frame_done.presentation_time = (uint64_t)presentation_time->time.tv_sec * 1000000000
+            + (uint64_t)presentation_time->time.tv_nsec;
+        frame_done.refresh_interval = presentation_time->period;
+        frame_done.sequence = presentation_time->frame;
+    }
+
+    // Not every driver reports it, the mode's refresh rate is close enough
+    if (frame_done.refresh_interval == 0) {
+        SRMConnectorMode* mode = srmConnectorGetCurrentMode(output->connector);
+        uint32_t refresh_rate = mode ? srmConnectorModeGetRefreshRate(mode) : 0;
+        if (refresh_rate != 0)
+            frame_done.refresh_interval = 1000000000 / refresh_rate;
+    }
+
+    application_waiters_presented(&output->drawn_present_waiters, frame_done);
+}
+
+// Sends the events of the waiters done since the last call
+static void application_send_present_events()
+{
+    uint64_t value;
+    if (read(APP.presented_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        log_log(LOG_WARNING, "Could not read frame presentation eventfd: %s",
+                strerror(errno));
+
+    pthread_mutex_lock(&APP.presented_mutex);
+
+    PresentWaiters presented_waiters = APP.presented_waiters;
+    APP.presented_waiters = APP.sent_waiters;
+
+    pthread_mutex_unlock(&APP.presented_mutex);
+
+    for (size_t i = 0; i < presented_waiters.waiters_count; ++i) {
+        present_waiter_finish(presented_waiters.waiters[i]);
+    }
+
+    presented_waiters.waiters_count = 0;
+    APP.sent_waiters = presented_waiters;
+}
+
+/*
+ * Hands the waiters to the outputs. Called after the damage was added,
+ * so the frames that take the waiters also draw what they wait for.
+ *
+ * Every output shows the same screen, so clients are paced by the first
+ * one. Buffers are only released once no output reads from them.
+ */
+static void application_add_present_waiters()
+{
+    if (APP.present_waiters.waiters_count == 0)
+        return;
+
+    pthread_mutex_lock(&APP.outputs_mutex);
+
+    size_t outputs_count = APP.outputs_count;
+    bool releases_buffers = false;
+    size_t kept_count = 0;
+
+    for (size_t i = 0; i < APP.present_waiters.waiters_count; ++i) {
+        PresentWaiter* waiter = APP.present_waiters.waiters[i];
+        bool first_output_only = waiter->event.kind == WREVENT_FRAME_DONE;
+
+        if (outputs_count == 0) {
+            // Nothing reads from the buffer, but frames wait for an
+            // output to be created
+            if (first_output_only)
+                APP.present_waiters.waiters[kept_count++] = waiter;
+            else
+                present_waiter_finish(waiter);
+            continue;
+        }
+
+        atomic_store(&waiter->outputs_left, first_output_only ? 1 : outputs_count);
+        releases_buffers = releases_buffers || !first_output_only;
+    }
+
+    for (size_t i = 0; i < outputs_count; ++i) {
+        Output* output = APP.outputs[i];
+        if (i != 0 && !releases_buffers)
+            break;
+
+        pthread_mutex_lock(&output->damage_mutex);
+        for (size_t j = 0; j < APP.present_waiters.waiters_count; ++j) {
+            PresentWaiter* waiter = APP.present_waiters.waiters[j];
+            if (i == 0 || waiter->event.kind != WREVENT_FRAME_DONE)
+                present_waiters_push(&output->present_waiters, waiter);
+        }
+        pthread_mutex_unlock(&output->damage_mutex);
+
+        srmConnectorRepaint(output->connector);
+    }
+
+    APP.present_waiters.waiters_count = kept_count;
+
+    pthread_mutex_unlock(&APP.outputs_mutex);
+}
+
+/*
+ * Damages windows that were opened, closed or moved up or down the stack
+ * since the last call, and the changed parts of window contents.
+ */
+static void application_damage_windows(Damage* damage)
+{
+    if (!server_take_windows_changed(APP.server))
+        return;
+
+    WindowStack* stack = server_acquire_windows(APP.server);
+    WindowStack* previous_stack = APP.damage_stack;
+
+    size_t previous_count = previous_stack ? previous_stack->windows_count : 0;
+    size_t count = stack->windows_count > previous_count
+        ? stack->windows_count
+        : previous_count;
+
+    for (size_t i = 0; i < count; ++i) {
+        Window* before = i < previous_count ? previous_stack->windows[i] : NULL;
+        Window* after = i < stack->windows_count ? stack->windows[i] : NULL;
+
+        if (before == after)
+            continue;
+
+        if (before)
+            wm_damage_window(damage, before);
+        if (after)
+            wm_damage_window(damage, after);
+    }
+
+    for (size_t i = 0; i < stack->windows_count; ++i) {
+        Window* window = stack->windows[i];
+
+        // Checked before the damage is taken, since clients damage their
+        // window before requesting the frame
+        if (atomic_exchange(&window->frame_requested, false)) {
+            WindowRendererEvent event = { .kind = WREVENT_FRAME_DONE };
+            present_waiters_push(&APP.present_waiters, present_waiter_create(window, event));
+        }
+
+        uint32_t replaced_buffers = window_take_replaced_buffers(window);
+        for (size_t j = 0; j < WR_WINDOW_BUFFERS_MAX; ++j) {
+            if (!(replaced_buffers & (1u << j)))
+                continue;
+
+            WindowRendererEvent event = {
+                .kind = WREVENT_BUFFER_RELEASE,
+                .event = {
+                    .buffer_release = { .buffer = j },
+                },
+            };
+            present_waiters_push(&APP.present_waiters, present_waiter_create(window, event));
+        }
+
+        WindowRect rect;
+        if (!window_take_damage(window, &rect))
+            continue;
+
+        Vector2 content_position = wm_compute_window_parameters(window).content_position;
+        damage_add_rect(damage,
+                        (Vector2) { content_position.x + rect.x, content_position.y + rect.y },
+                        (Vector2) { rect.width, rect.height });
+    }
+
+    if (previous_stack)
+        window_stack_unref(previous_stack);
+    APP.damage_stack = stack;
+}
+
+void application_get_wakeup_fds(int fds[APPLICATION_WAKEUP_FDS_COUNT])
+{
+    fds[0] = input_get_ready_fd();
+    fds[1] = server_get_windows_changed_fd(APP.server);
+    fds[2] = APP.presented_fd;
 }
 
 void application_update()
 {
-    wm_update(APP.server);
+    Damage damage = damage_empty();
+
+    // Taken first, so the input that woke the main thread up gets handled
+    // in this update rather than the next one
     input_update();
+    application_send_present_events();
+
+    wm_update(APP.server, &damage);
+    application_damage_windows(&damage);
+
+    Vector2 cursor_position = get_cursor_position();
+    if (cursor_position.x != APP.damage_cursor_position.x
+        || cursor_position.y != APP.damage_cursor_position.y) {
+        damage_add_rect(&damage, APP.damage_cursor_position, cursor_size);
+        damage_add_rect(&damage, cursor_position, cursor_size);
+        APP.damage_cursor_position = cursor_position;
+    }
+
+    // The frames drawing this damage are tied to the input that's new to
+    // them in the trace
+    uint64_t input_serial = input_get_serial();
+    if (!damage_is_empty(damage)) {
+        application_add_damage(damage,
+                               input_serial != APP.damage_input_serial ? input_serial : 0);
+        APP.damage_input_serial = input_serial;
+    }
+    application_add_present_waiters();
 }
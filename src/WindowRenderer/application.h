@@ -1,16 +1,126 @@
 #pragma once
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <SRMConnector.h>
+
+#include "damage.h"
+#include "dma_buf_cache.h"
+#include "region.h"
+#include "renderer/glyph_atlas.h"
 #include "renderer/renderer.h"
+#include "title_cache.h"
+#include "window_manager.h"
+
+/*
+ * How many buffers an output may cycle through. The buffer a frame is
+ * drawn into was last drawn up to that many frames ago, so everything
+ * damaged since then is drawn again.
+ */
+#define OUTPUT_BUFFERS_MAX 3
+
+/*
+ * Gets `event` sent to `window` once frames are presented: a
+ * WREVENT_FRAME_DONE once the first output presented one, or a
+ * WREVENT_BUFFER_RELEASE once every output did, since none of them reads
+ * from the buffer anymore then.
+ */
+typedef struct {
+    // Holds a reference
+    Window* window;
+    WindowRendererEvent event;
+    // Outputs that still have to present a frame
+    atomic_size_t outputs_left;
+} PresentWaiter;
+
+typedef struct {
+    PresentWaiter** waiters;
+    size_t waiters_count;
+    size_t waiters_capacity;
+} PresentWaiters;
+
+// A window with something to draw in the current frame
+typedef struct {
+    Window* window;
+    WMWindowParameters parameters;
+    // NULL until the client sets a buffer
+    Texture* texture;
+    // NULL if titles can't be drawn
+    Text* title;
+
+    // What's drawn of the window, in `Output.visible_rects`
+    size_t rects_begin;
+    size_t rects_end;
+} VisibleWindow;
+
+// What gets drawn on one connector, with its own GL context
+typedef struct {
+    SRMConnector* connector;
+    Renderer* renderer;
+    DmaBufCache* dma_buf_cache;
+
+    // Both are NULL if the font couldn't be loaded, titles aren't drawn
+    // then
+    GlyphAtlas* glyph_atlas;
+    TitleCache* title_cache;
+
+    // Added to from the main thread, taken when the output is rendered
+    pthread_mutex_t damage_mutex;
+    Damage damage;
+    PresentWaiters present_waiters;
+    // Serial of the newest input the damage shows, 0 if none
+    uint64_t damage_input_serial;
+
+    // What the last frame showed and when it was done rendering, for
+    // the trace
+    uint64_t drawn_input_serial;
+    uint64_t rendered_at;
+
+    // Taken by the frame being drawn, told about it once it's presented
+    PresentWaiters drawn_present_waiters;
+
+    // What the last frames redrew, newest first
+    Damage previous_damage[OUTPUT_BUFFERS_MAX - 1];
+
+    // Scratch space for finding what's visible of each window, kept
+    // between frames so it's not allocated again
+    Region visible_region;
+    Region covered_region;
+
+    // Windows drawn in the current frame, and the rectangles they're drawn
+    // in
+    VisibleWindow* visible_windows;
+    size_t visible_windows_count;
+    size_t visible_windows_capacity;
+    Region visible_rects;
+} Output;
 
 bool application_init(int argc, char const** argv);
 void application_terminate();
 
-void application_init_graphics(Renderer* renderer);
-void application_render(Renderer* renderer, EGLDisplay* egl_display);
+// Takes ownership of `renderer`
+Output* application_create_output(SRMConnector* connector, Renderer* renderer,
+                                  EGLDisplay* egl_display);
+void application_destroy_output(Output* output);
+
+// Redraws the whole output, for example after it was resized
+void application_damage_output(Output* output);
+
+void application_render(Output* output);
+// Called once the last frame rendered is shown on screen
+void application_output_presented(Output* output);
+
+#define APPLICATION_WAKEUP_FDS_COUNT 3
+
+// File descriptors that become readable when `application_update` has
+// something to do: input came in, windows changed or frames were
+// presented
+void application_get_wakeup_fds(int fds[APPLICATION_WAKEUP_FDS_COUNT]);
 
 void application_update();
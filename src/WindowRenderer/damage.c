@@ -0,0 +1,57 @@
+#include "damage.h"
+
+#include <math.h>
+
+Damage damage_empty(void)
+{
+    return (Damage) { 0, 0, 0, 0 };
+}
+
+bool damage_is_empty(Damage damage)
+{
+    return damage.x0 >= damage.x1 || damage.y0 >= damage.y1;
+}
+
+void damage_add(Damage* damage, Damage other)
+{
+    if (damage_is_empty(other))
+        return;
+
+    if (damage_is_empty(*damage)) {
+        *damage = other;
+        return;
+    }
+
+    if (other.x0 < damage->x0)
+        damage->x0 = other.x0;
+    if (other.y0 < damage->y0)
+        damage->y0 = other.y0;
+    if (other.x1 > damage->x1)
+        damage->x1 = other.x1;
+    if (other.y1 > damage->y1)
+        damage->y1 = other.y1;
+}
+
+void damage_add_rect(Damage* damage, Vector2 position, Vector2 size)
+{
+    damage_add(damage, (Damage) {
+                           .x0 = floorf(position.x),
+                           .y0 = floorf(position.y),
+                           .x1 = ceilf(position.x + size.x),
+                           .y1 = ceilf(position.y + size.y),
+                       });
+}
+
+Damage damage_clip(Damage damage, Vector2 size)
+{
+    if (damage.x0 < 0)
+        damage.x0 = 0;
+    if (damage.y0 < 0)
+        damage.y0 = 0;
+    if (damage.x1 > size.x)
+        damage.x1 = size.x;
+    if (damage.y1 > size.y)
+        damage.y1 = size.y;
+
+    return damage;
+}
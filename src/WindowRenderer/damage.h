@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/*
+ * The bounding box of everything that changed on screen, in pixels.
+ * Empty when `x0 >= x1` or `y0 >= y1`.
+ */
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} Damage;
+
+Damage damage_empty(void);
+bool damage_is_empty(Damage damage);
+
+// Grows `damage` to cover the rectangle, rounded out to whole pixels
+void damage_add_rect(Damage* damage, Vector2 position, Vector2 size);
+void damage_add(Damage* damage, Damage other);
+
+Damage damage_clip(Damage damage, Vector2 size);
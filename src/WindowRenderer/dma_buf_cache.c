@@ -0,0 +1,204 @@
+#include "dma_buf_cache.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "renderer/glext.h"
+
+#define DMA_BUF_CACHE_REPORT_INTERVAL_NS ((uint64_t)5 * 1000000000)
+// How long the rendering thread waits for a client's fence when the GPU
+// can't, so a client that never signals it doesn't stall the output
+#define DMA_BUF_CACHE_FENCE_TIMEOUT_MS 100
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+DmaBufCache* dma_buf_cache_create(EGLDisplay egl_display)
+{
+    DmaBufCache* cache = malloc(sizeof(*cache));
+    memset(cache, 0, sizeof(*cache));
+
+    cache->egl_display = egl_display;
+    window_entries_init(&cache->entries, sizeof(DmaBufCacheEntry));
+    cache->native_fence_sync = glext_load_native_fence_sync(egl_display);
+    cache->reported_at = get_time_ns();
+
+    if (!cache->native_fence_sync)
+        log_log(LOG_WARNING, "EGL_ANDROID_native_fence_sync is not supported, "
+                             "acquire fences will be waited for on the CPU");
+
+    return cache;
+}
+
+static void dma_buf_cache_release(DmaBufCache* cache, DmaBufCacheImage* image)
+{
+    if (image->texture)
+        texture_destroy(image->texture);
+    if (image->egl_image != EGL_NO_IMAGE_KHR)
+        eglDestroyImageKHR(cache->egl_display, image->egl_image);
+
+    image->texture = NULL;
+    image->egl_image = EGL_NO_IMAGE_KHR;
+}
+
+// Counts as an eviction if anything was imported for the entry
+static void dma_buf_cache_release_entry(void* entry, void* user_data)
+{
+    DmaBufCache* cache = user_data;
+    DmaBufCacheEntry* dma_buf_entry = entry;
+
+    bool imported = false;
+    for (size_t i = 0; i < WR_WINDOW_BUFFERS_MAX; ++i) {
+        imported = imported || dma_buf_entry->images[i].dma_buf.present;
+        dma_buf_cache_release(cache, &dma_buf_entry->images[i]);
+    }
+
+    if (imported)
+        cache->stats.evictions += 1;
+}
+
+void dma_buf_cache_destroy(DmaBufCache* cache)
+{
+    window_entries_destroy(&cache->entries, dma_buf_cache_release_entry, cache);
+    free(cache);
+}
+
+void dma_buf_cache_sync(DmaBufCache* cache, WindowStack* stack)
+{
+    window_entries_sync(&cache->entries, stack, dma_buf_cache_release_entry, cache);
+}
+
+// Makes the draws that follow wait for `fence`, which it takes ownership of
+static void dma_buf_cache_wait_fence(DmaBufCache* cache, int fence)
+{
+    if (cache->native_fence_sync) {
+        EGLint sync_attrs[] = {
+            EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence,
+            EGL_NONE
+        };
+
+        EGLSyncKHR sync = eglCreateSyncKHR(cache->egl_display,
+                                           EGL_SYNC_NATIVE_FENCE_ANDROID,
+                                           sync_attrs);
+        if (sync != EGL_NO_SYNC_KHR) {
+            // The sync owns the fence now. Destroying it doesn't cancel
+            // the wait
+            eglWaitSyncKHR(cache->egl_display, sync, 0);
+            eglDestroySyncKHR(cache->egl_display, sync);
+            cache->stats.gpu_waits += 1;
+            return;
+        }
+
+        log_log(LOG_WARNING, "Could not create EGL sync from acquire fence");
+    }
+
+    struct pollfd fence_poll = { .fd = fence, .events = POLLIN };
+    int result;
+    do {
+        result = poll(&fence_poll, 1, DMA_BUF_CACHE_FENCE_TIMEOUT_MS);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == 0)
+        log_log(LOG_WARNING, "Acquire fence wasn't signaled after %d ms",
+                DMA_BUF_CACHE_FENCE_TIMEOUT_MS);
+
+    close(fence);
+    cache->stats.cpu_waits += 1;
+}
+
+static Texture* dma_buf_cache_import(DmaBufCache* cache, DmaBufCacheEntry* entry,
+                                     Window* window, size_t buffer, WindowDmaBuf dma_buf)
+{
+    DmaBufCacheImage* image = &entry->images[buffer];
+
+    if (image->dma_buf.present == dma_buf.present && image->dma_buf.serial == dma_buf.serial)
+        return image->texture;
+
+    // The slot got a new buffer
+    dma_buf_cache_release(cache, image);
+    image->dma_buf = dma_buf;
+
+    if (!dma_buf.present)
+        return NULL;
+
+    EGLint image_attrs[] = {
+        EGL_WIDTH, dma_buf.width,
+        EGL_HEIGHT, dma_buf.height,
+        EGL_LINUX_DRM_FOURCC_EXT, dma_buf.format,
+        EGL_DMA_BUF_PLANE0_FD_EXT, dma_buf.fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, dma_buf.stride,
+        EGL_NONE
+    };
+
+    image->egl_image = eglCreateImageKHR(cache->egl_display, EGL_NO_CONTEXT,
+                                         EGL_LINUX_DMA_BUF_EXT,
+                                         NULL,
+                                         image_attrs);
+    if (image->egl_image == EGL_NO_IMAGE_KHR) {
+        log_log(LOG_ERROR, "Could not create EGL image from DMA buffer of window of ID %d",
+                window->id);
+        cache->stats.failed_imports += 1;
+        return NULL;
+    }
+
+    image->texture = texture_create_from_egl_imagekhr(image->egl_image,
+                                                      dma_buf.width,
+                                                      dma_buf.height);
+    cache->stats.imports += 1;
+
+    return image->texture;
+}
+
+Texture* dma_buf_cache_get(DmaBufCache* cache, size_t stack_index, Window* window)
+{
+    DmaBufCacheEntry* entry = window_entries_get(&cache->entries, stack_index);
+
+    WindowShownBuffer shown = window_get_shown_buffer(window, entry->waited_commit);
+    entry->waited_commit = shown.commit;
+
+    Texture* texture = dma_buf_cache_import(cache, entry, window, shown.buffer, shown.dma_buf);
+
+    if (shown.acquire_fence != -1)
+        dma_buf_cache_wait_fence(cache, shown.acquire_fence);
+
+    return texture;
+}
+
+void dma_buf_cache_report(DmaBufCache* cache)
+{
+    uint64_t now = get_time_ns();
+    uint64_t elapsed = now - cache->reported_at;
+    if (elapsed < DMA_BUF_CACHE_REPORT_INTERVAL_NS)
+        return;
+
+    size_t imports = cache->stats.imports - cache->reported_stats.imports;
+    size_t failed_imports = cache->stats.failed_imports - cache->reported_stats.failed_imports;
+    size_t evictions = cache->stats.evictions - cache->reported_stats.evictions;
+    size_t gpu_waits = cache->stats.gpu_waits - cache->reported_stats.gpu_waits;
+    size_t cpu_waits = cache->stats.cpu_waits - cache->reported_stats.cpu_waits;
+
+    double seconds = elapsed / 1e9;
+
+    if (imports != 0 || failed_imports != 0) {
+        log_log(LOG_INFO, "DMA buffer imports: %.1f/s (%.1f/s failed), %zu closed windows evicted",
+                imports / seconds, failed_imports / seconds, evictions);
+    }
+
+    if (gpu_waits != 0 || cpu_waits != 0) {
+        log_log(LOG_INFO, "Acquire fences: %.1f/s waited for by the GPU, %.1f/s on the CPU",
+                gpu_waits / seconds, cpu_waits / seconds);
+    }
+
+    cache->reported_stats = cache->stats;
+    cache->reported_at = now;
+}
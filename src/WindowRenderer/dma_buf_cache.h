@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "renderer/opengl/texture.h"
+#include "server/window.h"
+#include "server/window_stack.h"
+#include "window_entries.h"
+
+/*
+ * Keeps the EGL images and textures imported from the DMA buffers of
+ * each window across frames. A buffer is only imported again when its
+ * slot gets another buffer, so windows switching between their buffers
+ * don't cause imports. They're dropped when the window closes.
+ *
+ * Textures belong to the GL context of one output, so every output has
+ * its own cache, only used from that output's rendering thread.
+ */
+typedef struct {
+    // What `egl_image` was imported from
+    WindowDmaBuf dma_buf;
+
+    // Both are unset if the import failed. It isn't retried until the
+    // slot gets a new buffer
+    EGLImageKHR egl_image;
+    Texture* texture;
+} DmaBufCacheImage;
+
+// Zeroed when created, which leaves every image unset
+typedef struct {
+    // One per buffer slot of the window
+    DmaBufCacheImage images[WR_WINDOW_BUFFERS_MAX];
+    // Commit whose acquire fence was last waited for
+    uint64_t waited_commit;
+} DmaBufCacheEntry;
+
+typedef struct {
+    size_t imports;
+    size_t failed_imports;
+    size_t evictions;
+    // Acquire fences waited for by the GPU, and by the rendering thread
+    // when the GPU can't
+    size_t gpu_waits;
+    size_t cpu_waits;
+} DmaBufCacheStats;
+
+typedef struct {
+    EGLDisplay egl_display;
+    // Whether the GPU can wait for acquire fences
+    bool native_fence_sync;
+
+    // Of DmaBufCacheEntry
+    WindowEntries entries;
+
+    DmaBufCacheStats stats;
+    DmaBufCacheStats reported_stats;
+    uint64_t reported_at;
+} DmaBufCache;
+
+DmaBufCache* dma_buf_cache_create(EGLDisplay egl_display);
+void dma_buf_cache_destroy(DmaBufCache* cache);
+
+// Lines the cache up with `stack`, dropping the entries of windows that
+// aren't in it anymore. Call it at the start of every frame
+void dma_buf_cache_sync(DmaBufCache* cache, WindowStack* stack);
+
+/*
+ * Returns the texture of the buffer shown by `window`, at `stack_index`
+ * in the last synced stack, importing the buffer if its slot got another
+ * one. Draws made afterwards wait for the acquire fence of the commit.
+ * Returns NULL if the import failed.
+ */
+Texture* dma_buf_cache_get(DmaBufCache* cache, size_t stack_index, Window* window);
+
+// Logs how many imports happened per second, at most every few seconds,
+// and only if there were any
+void dma_buf_cache_report(DmaBufCache* cache);
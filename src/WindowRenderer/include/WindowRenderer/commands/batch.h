@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// Maximum amount of commands carried by a single batch
+#define WR_BATCH_COMMANDS_MAX 64
+
+typedef struct {
+    uint32_t count;
+} WindowRendererBatch;
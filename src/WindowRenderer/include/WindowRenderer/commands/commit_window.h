@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Shows `buffer` as the window's content from the next frame on, with
+ * the given part of the content changed since the last commit. The
+ * buffer shown until then gets a WREVENT_BUFFER_RELEASE once the server
+ * stopped reading from it, and may only be drawn into after that.
+ * Committing a buffer that wasn't released yet fails.
+ *
+ * The command may come with one file descriptor: a sync_file fence
+ * signaled once the client's drawing into the buffer is done. The
+ * server's GPU waits for it before reading from the buffer, so clients
+ * don't have to wait for their drawing to finish before committing.
+ */
+typedef struct {
+    int window_id;
+    uint32_t buffer;
+    int x;
+    int y;
+    int width;
+    int height;
+} WindowRendererCommitWindow;
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Tells the server which part of a window's content changed, in pixels
+ * from the top-left corner of the content. The server only redraws what
+ * changed, so clients send this after drawing into their buffer. Setting
+ * a new buffer damages the whole window.
+ */
+typedef struct {
+    int window_id;
+    int x;
+    int y;
+    int width;
+    int height;
+} WindowRendererDamageWindow;
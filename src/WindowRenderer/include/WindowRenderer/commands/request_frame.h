@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Asks the server to send WREVENT_FRAME_DONE once the window's content,
+ * as of this command, was shown on screen. The event is sent once per
+ * command, so clients that want to render once per displayed frame send
+ * this along with the damage of every frame.
+ */
+typedef struct {
+    int window_id;
+} WindowRendererRequestFrame;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// Maximum amount of events an event ring can hold
+#define WR_EVENT_RING_CAPACITY_MAX 4096
+
+typedef struct {
+    // Amount of events the ring can hold. Must be a power of two
+    uint32_t capacity;
+} WindowRendererSetEventRing;
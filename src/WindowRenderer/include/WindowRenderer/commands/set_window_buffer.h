@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "set_window_dma_buf.h"
+
+// How many buffers a window may have
+#define WR_WINDOW_BUFFERS_MAX 4
+
+/*
+ * Puts a DMA buffer in slot `buffer` of the window, which is less than
+ * WR_WINDOW_BUFFERS_MAX. It isn't shown until it's committed with
+ * WRCMD_COMMIT_WINDOW. A slot can't be replaced while its buffer is shown
+ * or hasn't been released yet.
+ */
+typedef struct {
+    int window_id;
+    uint32_t buffer;
+    WindowRendererDmaBuf dma_buf;
+} WindowRendererSetWindowBuffer;
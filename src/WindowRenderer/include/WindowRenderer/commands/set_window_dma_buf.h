@@ -9,6 +9,11 @@ typedef struct {
     int stride;
 } WindowRendererDmaBuf;
 
+/*
+ * Puts the DMA buffer in slot 0 and shows it right away. The server may
+ * read from it while the client draws into it; WRCMD_SET_WINDOW_BUFFER
+ * and WRCMD_COMMIT_WINDOW don't have that problem.
+ */
 typedef struct {
     int window_id;
     WindowRendererDmaBuf dma_buf;
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// The server won't read from the buffer in slot `buffer` anymore, so
+// the client can draw into it again
+typedef struct {
+    uint32_t buffer;
+} WindowRendererBufferRelease;
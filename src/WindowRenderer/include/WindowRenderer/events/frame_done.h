@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    // When the frame started being shown, in nanoseconds of
+    // CLOCK_MONOTONIC
+    uint64_t presentation_time;
+    // Time between two frames of the output in nanoseconds, so the next
+    // one is shown at `presentation_time + refresh_interval`. 0 if unknown
+    uint64_t refresh_interval;
+    // Counts the frames presented by the output. Frames skipped between
+    // two events show up as a gap
+    uint64_t sequence;
+} WindowRendererFrameDone;
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t count;
+} WindowRendererBatchResponse;
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "commands/batch.h"
 #include "commands/create_window.h"
 #include "commands/close_window.h"
+#include "commands/commit_window.h"
+#include "commands/damage_window.h"
+#include "commands/request_frame.h"
+#include "commands/set_event_ring.h"
+#include "commands/set_window_buffer.h"
 #include "commands/set_window_dma_buf.h"
 
+#include "responses/batch.h"
 #include "responses/window_id.h"
 
+#include "events/buffer_release.h"
+#include "events/frame_done.h"
 #include "events/mouse_button.h"
 #include "events/mouse_move.h"
 
@@ -17,10 +31,37 @@
  * The format for a WindowRenderer instance's socket path is:
  *
  *    - /tmp/WindowRenderer_<hash>.sock
+ *
+ * Clients send commands on that socket, and the server sends back
+ * messages: responses to commands, and the events of every window the
+ * client created, tagged with the window's ID.
  */
 
 #define WR_SESSION_HASH_ENV "WINDOW_RENDERER_SESSION_HASH"
 
+/*
+ * Every command carries a request ID chosen by the client, which the
+ * server copies into the matching response. Clients may send several
+ * commands before reading any response (pipelining) and use the ID to
+ * match responses to commands. The ID 0 is reserved.
+ */
+
+#define WR_REQUEST_ID_INVALID 0
+
+#define WR_COMMAND_FDS_MAX 3
+
+/*
+ * File descriptors are sent over SCM_RIGHTS, and `fd_count` tells how
+ * many of them belong to a command (at most WR_COMMAND_FDS_MAX). The
+ * server consumes them in the same order the commands were sent.
+ *
+ * A WRCMD_BATCH command is immediately followed, in the same message,
+ * by `batch.count` regular commands (batches can't be nested). All of
+ * their file descriptors are sent along with the message. The server
+ * answers with a single WRRESP_BATCH response, immediately followed by
+ * one response per command, in order.
+ */
+
 // ========================= //
 
 /*                             *
@@ -31,15 +72,29 @@ typedef enum {
     WRCMD_CREATE_WINDOW,
     WRCMD_CLOSE_WINDOW,
     WRCMD_SET_WINDOW_DMA_BUF,
+    WRCMD_BATCH,
+    WRCMD_SET_EVENT_RING,
+    WRCMD_DAMAGE_WINDOW,
+    WRCMD_REQUEST_FRAME,
+    WRCMD_SET_WINDOW_BUFFER,
+    WRCMD_COMMIT_WINDOW,
 } WindowRendererCommandKind;
 
 typedef struct {
     WindowRendererCommandKind kind;
+    uint32_t request_id;
+    uint32_t fd_count;
 
     union {
+        WindowRendererBatch batch;
         WindowRendererCreateWindow create_window;
         WindowRendererCloseWindow close_window;
         WindowRendererSetWindowDmaBuf set_window_dma_buf;
+        WindowRendererSetEventRing set_event_ring;
+        WindowRendererDamageWindow damage_window;
+        WindowRendererRequestFrame request_frame;
+        WindowRendererSetWindowBuffer set_window_buffer;
+        WindowRendererCommitWindow commit_window;
     } command;
 } WindowRendererCommand;
 
@@ -53,25 +108,34 @@ typedef struct {
  *   -=-= BEGIN RESPONSE =-=-   *
  *                              */
 
+// New statuses go at the end, so existing ones keep their value on the
+// wire
 typedef enum {
     WRSTATUS_INVALID_COMMAND,
     WRSTATUS_INVALID_WINID,
     WRSTATUS_INVALID_DMA_BUF_FD,
     WRSTATUS_INVALID_DMA_BUF_SIZE,
+    WRSTATUS_INVALID_EVENT_RING,
     WRSTATUS_OK,
+    WRSTATUS_TOO_MANY_WINDOWS,
+    WRSTATUS_INVALID_BUFFER,
+    WRSTATUS_BUFFER_BUSY,
 } WindowRendererStatus;
 
 typedef enum {
     WRRESP_WINID,
     WRRESP_EMPTY,
+    WRRESP_BATCH,
 } WindowRendererResponseKind;
 
 typedef struct {
     WindowRendererResponseKind kind;
     WindowRendererStatus status;
+    uint32_t request_id;
 
     union {
         WindowRendererWindowId window_id;
+        WindowRendererBatchResponse batch;
     } response;
 } WindowRendererResponse;
 
@@ -89,14 +153,19 @@ typedef enum {
     WREVENT_CLOSE_WINDOW,
     WREVENT_MOUSE_BUTTON,
     WREVENT_MOUSE_MOVE,
+    WREVENT_FRAME_DONE,
+    WREVENT_BUFFER_RELEASE,
 } WindowRendererEventKind;
 
 typedef struct {
     WindowRendererEventKind kind;
+    int window_id;
 
     union {
         WindowRendererMouseButton mouse_button;
         WindowRendererMouseMove mouse_move;
+        WindowRendererFrameDone frame_done;
+        WindowRendererBufferRelease buffer_release;
     } event;
 } WindowRendererEvent;
 
@@ -105,3 +174,160 @@ typedef struct {
  *                         */
 
 // ========================= //
+
+/*                             *
+ *   -=-= BEGIN MESSAGE =-=-   *
+ *                             */
+
+typedef enum {
+    WRMSG_RESPONSE,
+    WRMSG_EVENT,
+} WindowRendererMessageKind;
+
+typedef struct {
+    WindowRendererMessageKind kind;
+
+    union {
+        WindowRendererResponse response;
+        WindowRendererEvent event;
+    } message;
+} WindowRendererMessage;
+
+/*                           *
+ *   -=-= END MESSAGE =-=-   *
+ *                           */
+
+// ========================= //
+
+/*                           *
+ *   -=-= BEGIN FRAME =-=-   *
+ *                           */
+
+/*
+ * Commands and messages are not sent as the structs above, but encoded
+ * into frames: a WindowRendererFrameHeader followed by a payload, whose
+ * size depends on the kind of frame. `size` covers the whole frame,
+ * header included, and is at most WR_FRAME_SIZE_MAX. Frames of another
+ * `version` than WR_PROTOCOL_VERSION are not understood, and the
+ * connection is closed.
+ *
+ * Command frames have `kind` set to a WindowRendererCommandKind and `id`
+ * set to the request ID. The payload is:
+ *
+ *     uint32_t fd_count;
+ *     followed by the matching member of `WindowRendererCommand.command`,
+ *     except for WRCMD_CREATE_WINDOW:
+ *
+ *         int width;
+ *         int height;
+ *         char title[];  // Not NUL terminated, up to the end of the frame
+ *
+ * Message frames have `kind` set to a WindowRendererMessageKind. For
+ * responses, `id` is the request ID and the payload is:
+ *
+ *     WindowRendererResponseKind kind;
+ *     WindowRendererStatus status;
+ *     followed by the matching member of `response` (nothing for
+ *     WRRESP_EMPTY)
+ *
+ * For events, `id` is the window ID and the payload is:
+ *
+ *     WindowRendererEventKind kind;
+ *     followed by the matching member of `event` (nothing for
+ *     WREVENT_CLOSE_WINDOW)
+ */
+
+#define WR_PROTOCOL_VERSION 4
+#define WR_FRAME_SIZE_MAX 1024
+
+typedef struct {
+    uint16_t size;
+    uint8_t version;
+    uint8_t kind;
+    // Request ID, or window ID for events
+    uint32_t id;
+} WindowRendererFrameHeader;
+
+typedef enum {
+    WR_FRAME_OK,
+    // The rest of the frame hasn't been received yet
+    WR_FRAME_INCOMPLETE,
+    // Not a frame we understand. The stream can't be trusted anymore
+    WR_FRAME_INVALID,
+} WindowRendererFrameStatus;
+
+// Checks the frame at the start of `data`. On WR_FRAME_OK, `*frame_size`
+// is set to the size of the whole frame. Used by both ends of the
+// connection
+static inline WindowRendererFrameStatus wr_check_frame(unsigned char const* data, size_t size,
+                                                       size_t* frame_size)
+{
+    if (size < sizeof(WindowRendererFrameHeader))
+        return WR_FRAME_INCOMPLETE;
+
+    WindowRendererFrameHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != WR_PROTOCOL_VERSION
+        || header.size < sizeof(header)
+        || header.size > WR_FRAME_SIZE_MAX)
+        return WR_FRAME_INVALID;
+
+    if (size < header.size)
+        return WR_FRAME_INCOMPLETE;
+
+    *frame_size = header.size;
+    return WR_FRAME_OK;
+}
+
+/*                         *
+ *   -=-= END FRAME =-=-   *
+ *                         */
+
+// ========================= //
+
+/*                                *
+ *   -=-= BEGIN EVENT RING =-=-   *
+ *                                */
+
+/*
+ * Instead of having events sent on the server connection, a client may
+ * share a ring of events with the server, by sending WRCMD_SET_EVENT_RING
+ * along with three file descriptors:
+ *
+ *   1. A memfd sealed with at least F_SEAL_SHRINK, holding a zeroed
+ *      WindowRendererEventRing followed by `capacity` events
+ *   2. An eventfd the server writes to after queueing events, if
+ *      `client_sleeping` was set
+ *   3. An eventfd the client writes to after reading events, if
+ *      `server_waiting` was set
+ *
+ * Events sent after the response to that command are only written to
+ * the ring. The event at index `i` is stored in `events[i % capacity]`,
+ * and the indices wrap around at 2^32.
+ *
+ * The server publishes events by storing `tail` with release ordering,
+ * and the client hands their slots back by storing `head` the same way.
+ * Neither side makes a system call unless the other one said, through
+ * its flag, that it is waiting.
+ */
+
+typedef struct {
+    // Index of the next event to be read. Written by the client
+    _Alignas(64) _Atomic uint32_t head;
+    // Set by the client before waiting on the eventfd
+    _Atomic uint32_t client_sleeping;
+
+    // Index past the newest event. Written by the server
+    _Alignas(64) _Atomic uint32_t tail;
+    // Set by the server when the ring was full
+    _Atomic uint32_t server_waiting;
+
+    _Alignas(64) WindowRendererEvent events[];
+} WindowRendererEventRing;
+
+/*                              *
+ *   -=-= END EVENT RING =-=-   *
+ *                              */
+
+// ========================= //
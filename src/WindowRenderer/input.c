@@ -1,9 +1,16 @@
 #include "input.h"
 
+#include <errno.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include "input_events/mouse.h"
+#include "log.h"
+#include "trace.h"
 
 static inline Vector2 vector2_clamp(Vector2 v, Vector2 min, Vector2 max)
 {
@@ -19,17 +26,40 @@ struct {
     Vector2 next_cursor_position;
     Vector2 prev_cursor_position;
 
+    // Written by the mouse threads, copied to `curr_mouse_buttons` by
+    // `input_update`
     bool mouse_buttons[COUNT_INPUT_MOUSE_BUTTON];
+    bool curr_mouse_buttons[COUNT_INPUT_MOUSE_BUTTON];
     bool prev_mouse_buttons[COUNT_INPUT_MOUSE_BUTTON];
+
+    // Written after every input event, see `input_get_ready_fd`
+    int ready_fd;
+
+    // Numbers input events for the trace. `serial` is the last one taken
+    // by `input_update`
+    atomic_uint_fast64_t next_serial;
+    uint64_t serial;
 } INPUT;
 
-static void mouse_button(InputMouseButton button, bool released, void* user_data)
+// `time` is when the kernel got the event
+static void input_notify_ready(uint64_t time)
+{
+    uint64_t serial = atomic_fetch_add(&INPUT.next_serial, 1) + 1;
+    trace_record(TRACE_INPUT_READ, time, trace_now(), serial);
+
+    uint64_t value = 1;
+    if (write(INPUT.ready_fd, &value, sizeof(value)) == -1)
+        log_log(LOG_WARNING, "Could not signal input event: %s", strerror(errno));
+}
+
+static void mouse_button(InputMouseButton button, bool released, uint64_t time, void* user_data)
 {
     (void)user_data;
     INPUT.mouse_buttons[button] = !released;
+    input_notify_ready(time);
 }
 
-static void mouse_move(InputMouseAxis axis, int units, void* user_data)
+static void mouse_move(InputMouseAxis axis, int units, uint64_t time, void* user_data)
 {
     (void)user_data;
 
@@ -48,31 +78,59 @@ static void mouse_move(InputMouseAxis axis, int units, void* user_data)
     INPUT.next_cursor_position = vector2_clamp(next_cursor_position,
                                                (Vector2) { 0, 0 },
                                                INPUT.cursor_bounds);
+    input_notify_ready(time);
 }
 
-static void mouse_scroll(int detents, void* user_data)
+static void mouse_scroll(int detents, uint64_t time, void* user_data)
 {
     (void)detents;
+    (void)time;
     (void)user_data;
 }
 
-void input_start_processing()
+bool input_start_processing()
 {
     memset(&INPUT, 0, sizeof(INPUT));
 
+    INPUT.ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (INPUT.ready_fd == -1) {
+        log_log(LOG_ERROR, "Could not create input eventfd: %s", strerror(errno));
+        return false;
+    }
+
     InputMouseInterface mouse_interface = {
         .button = mouse_button,
         .move = mouse_move,
         .scroll = mouse_scroll,
     };
     input_mouse_start_processing(mouse_interface, NULL);
+
+    return true;
+}
+
+int input_get_ready_fd()
+{
+    return INPUT.ready_fd;
+}
+
+uint64_t input_get_serial()
+{
+    return INPUT.serial;
 }
 
 void input_update()
 {
+    // Drained before the state is copied, so events coming in after the
+    // copy make the file descriptor readable again
+    uint64_t value;
+    if (read(INPUT.ready_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        log_log(LOG_WARNING, "Could not read input eventfd: %s", strerror(errno));
+
+    INPUT.serial = atomic_load(&INPUT.next_serial);
     INPUT.prev_cursor_position = INPUT.curr_cursor_position;
     INPUT.curr_cursor_position = INPUT.next_cursor_position;
-    memcpy(INPUT.prev_mouse_buttons, INPUT.mouse_buttons, sizeof(INPUT.mouse_buttons));
+    memcpy(INPUT.prev_mouse_buttons, INPUT.curr_mouse_buttons, sizeof(INPUT.curr_mouse_buttons));
+    memcpy(INPUT.curr_mouse_buttons, INPUT.mouse_buttons, sizeof(INPUT.mouse_buttons));
 }
 
 void input_set_cursor_bounds(Vector2 bounds)
@@ -87,17 +145,17 @@ Vector2 input_get_cursor_bounds()
 
 bool is_mouse_button_just_pressed(InputMouseButton button)
 {
-    return INPUT.mouse_buttons[button] && !INPUT.prev_mouse_buttons[button];
+    return INPUT.curr_mouse_buttons[button] && !INPUT.prev_mouse_buttons[button];
 }
 
 bool is_mouse_button_just_released(InputMouseButton button)
 {
-    return INPUT.prev_mouse_buttons[button] && !INPUT.mouse_buttons[button];
+    return INPUT.prev_mouse_buttons[button] && !INPUT.curr_mouse_buttons[button];
 }
 
 bool is_mouse_button_pressed(InputMouseButton button)
 {
-    return INPUT.mouse_buttons[button];
+    return INPUT.curr_mouse_buttons[button];
 }
 
 Vector2 get_cursor_position()
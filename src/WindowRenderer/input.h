@@ -1,12 +1,19 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "input_events/mouse.h"
 #include "types.h"
 
-void input_start_processing();
+// Returns false on error
+bool input_start_processing();
+// Becomes readable when input events come in. Drained by `input_update`
+int input_get_ready_fd();
+// Takes the input that came in since the last call
 void input_update();
+// Serial of the last input event `input_update` took, 0 before any
+uint64_t input_get_serial();
 
 void input_set_cursor_bounds(Vector2 bounds);
 Vector2 input_get_cursor_bounds();
@@ -11,9 +11,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "log.h"
+#include "trace.h"
 
 typedef struct {
     int mouse_fd;
@@ -27,6 +29,12 @@ static void* process_mouse_events(ProcessMouseEventsInfo* info)
     InputMouseInterface mouse_interface = info->interface;
     void* user_data = info->user_data;
 
+    // So that event timestamps can be compared with the rest of the trace
+    int clock_id = CLOCK_MONOTONIC;
+    bool monotonic_time = ioctl(mouse_fd, EVIOCSCLOCKID, &clock_id) != -1;
+
+    trace_name_thread("Mouse");
+
     struct input_event event;
     size_t bytes_read;
     while ((bytes_read = read(mouse_fd, &event, sizeof(struct input_event))) > 0) {
@@ -35,6 +43,12 @@ static void* process_mouse_events(ProcessMouseEventsInfo* info)
             continue;
         }
 
+        uint64_t time = (uint64_t)event.time.tv_sec * 1000000000
+            + (uint64_t)event.time.tv_usec * 1000;
+        // The kernel stamps events with the real time clock then
+        if (!monotonic_time)
+            time = trace_now();
+
         if (event.type == EV_KEY) {
             InputMouseButton mouse_button;
 
@@ -56,7 +70,7 @@ static void* process_mouse_events(ProcessMouseEventsInfo* info)
             }
 
             if (mouse_interface.button)
-                mouse_interface.button(mouse_button, event.value == 0, user_data);
+                mouse_interface.button(mouse_button, event.value == 0, time, user_data);
 
         } else if (event.type == EV_REL && (event.code == REL_X || event.code == REL_Y)) {
             InputMouseAxis mouse_axis;
@@ -75,11 +89,11 @@ static void* process_mouse_events(ProcessMouseEventsInfo* info)
             }
 
             if (mouse_interface.move)
-                mouse_interface.move(mouse_axis, event.value, user_data);
+                mouse_interface.move(mouse_axis, event.value, time, user_data);
 
         } else if (event.type == EV_REL && event.code == REL_WHEEL) {
             if (mouse_interface.scroll)
-                mouse_interface.scroll(event.value, user_data);
+                mouse_interface.scroll(event.value, time, user_data);
         }
     }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     INPUT_MOUSE_AXIS_X,
@@ -14,10 +15,12 @@ typedef enum {
     COUNT_INPUT_MOUSE_BUTTON,
 } InputMouseButton;
 
+// `time` is when the kernel got the event, on CLOCK_MONOTONIC, in
+// nanoseconds
 typedef struct {
-    void (*button)(InputMouseButton button, bool released, void* user_data);
-    void (*move)(InputMouseAxis axis, int units, void* user_data);
-    void (*scroll)(int detents, void* user_data);
+    void (*button)(InputMouseButton button, bool released, uint64_t time, void* user_data);
+    void (*move)(InputMouseAxis axis, int units, uint64_t time, void* user_data);
+    void (*scroll)(int detents, uint64_t time, void* user_data);
 } InputMouseInterface;
 
 void input_mouse_start_processing(InputMouseInterface interface, void* user_data);
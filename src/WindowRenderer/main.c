@@ -7,9 +7,14 @@
 #include <SRMList.h>
 #include <SRMLog.h>
 
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include <EGL/egl.h>
@@ -18,8 +23,11 @@
 #include "log.h"
 #include "renderer/renderer.h"
 #include "renderer/opengl/gl_errors.h"
+#include "trace.h"
 
-bool should_quit = false;
+volatile sig_atomic_t should_quit = false;
+// Written by `ctrl_c`, which may run on any thread, to wake the main loop up
+static int quit_fd = -1;
 
 // Set only once. The same resolution is used
 // for all monitors.
@@ -62,9 +70,17 @@ static void initialize_gl(SRMConnector* connector, void* user_data)
     // must set it manually.
     gl(Viewport, 0, 0, width, height);
 
+    // Each connector renders on a thread of its own
+    char thread_name[64];
+    snprintf(thread_name, sizeof(thread_name), "Output %s", srmConnectorGetModel(connector));
+    trace_name_thread(thread_name);
+
+    SRMDevice* device = srmConnectorGetDevice(connector);
+    EGLDisplay* egl_display = srmDeviceGetEGLDisplay(device);
+
     Renderer* renderer = renderer_create(screen_width, screen_height);
-    application_init_graphics(renderer);
-    srmConnectorSetUserData(connector, renderer);
+    Output* output = application_create_output(connector, renderer, egl_display);
+    srmConnectorSetUserData(connector, output);
 
     srmConnectorRepaint(connector);
 }
@@ -73,26 +89,26 @@ static void paint_gl(SRMConnector* connector, void* user_data)
 {
     (void)user_data;
 
-    Renderer* renderer = srmConnectorGetUserData(connector);
-
-    SRMDevice* device = srmConnectorGetDevice(connector);
-    EGLDisplay* egl_display = srmDeviceGetEGLDisplay(device);
-
-    application_render(renderer, egl_display);
+    Output* output = srmConnectorGetUserData(connector);
 
-    srmConnectorRepaint(connector);
+    // The next frame is only requested when something gets damaged
+    application_render(output);
 }
 
 static void resize_gl(SRMConnector* connector, void* user_data)
 {
     (void)user_data;
-    srmConnectorRepaint(connector);
+
+    Output* output = srmConnectorGetUserData(connector);
+    application_damage_output(output);
 }
 
 static void page_flipped(SRMConnector* connector, void* user_data)
 {
-    (void)connector;
     (void)user_data;
+
+    Output* output = srmConnectorGetUserData(connector);
+    application_output_presented(output);
 }
 
 static void uninitialize_gl(SRMConnector* connector, void* user_data)
@@ -100,8 +116,8 @@ static void uninitialize_gl(SRMConnector* connector, void* user_data)
     (void)connector;
     (void)user_data;
 
-    Renderer* renderer = srmConnectorGetUserData(connector);
-    renderer_destroy(renderer);
+    Output* output = srmConnectorGetUserData(connector);
+    application_destroy_output(output);
 }
 
 static SRMConnectorInterface connector_interface = {
@@ -131,12 +147,27 @@ void ctrl_c(int signo)
 {
     (void)signo;
     should_quit = true;
+
+    uint64_t value = 1;
+    ssize_t result = write(quit_fd, &value, sizeof(value));
+    (void)result;
 }
 
 int main(int argc, char const** argv)
 {
+    quit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (quit_fd == -1) {
+        log_log(LOG_ERROR, "Could not create quit eventfd: %s", strerror(errno));
+        return 1;
+    }
+
     signal(SIGINT, ctrl_c);
 
+    // Before the other threads are started
+    if (!trace_init())
+        return 1;
+    trace_name_thread("Main");
+
     if (!application_init(argc, argv))
         return 1;
 
@@ -169,9 +200,49 @@ int main(int argc, char const** argv)
         }
     }
 
+    enum {
+        POLL_MONITOR,
+        POLL_QUIT,
+        POLL_TRACE,
+        POLL_APPLICATION,
+        COUNT_POLL = POLL_APPLICATION + APPLICATION_WAKEUP_FDS_COUNT,
+    };
+
+    struct pollfd poll_fds[COUNT_POLL];
+    poll_fds[POLL_MONITOR].fd = srmCoreGetMonitorFD(core);
+    poll_fds[POLL_QUIT].fd = quit_fd;
+    // Ignored by `poll` when tracing is off
+    poll_fds[POLL_TRACE].fd = trace_get_dump_fd();
+
+    int application_fds[APPLICATION_WAKEUP_FDS_COUNT];
+    application_get_wakeup_fds(application_fds);
+    for (size_t i = 0; i < APPLICATION_WAKEUP_FDS_COUNT; ++i) {
+        poll_fds[POLL_APPLICATION + i].fd = application_fds[i];
+    }
+
+    for (size_t i = 0; i < COUNT_POLL; ++i) {
+        poll_fds[i].events = POLLIN;
+    }
+
+    // Frames are drawn by the connector threads whenever damage comes in,
+    // so the main thread only wakes up for hotplug, input, window changes,
+    // trace dumps and quitting
     while (!should_quit) {
-        if (srmCoreProcessMonitor(core, 0) == -1)
+        if (poll(poll_fds, COUNT_POLL, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            log_log(LOG_ERROR, "Could not wait for events: %s", strerror(errno));
             break;
+        }
+
+        if (poll_fds[POLL_MONITOR].revents & POLLIN) {
+            if (srmCoreProcessMonitor(core, 0) == -1)
+                break;
+        }
+
+        if (poll_fds[POLL_TRACE].revents & POLLIN)
+            trace_dump();
+
         application_update();
     }
 
@@ -179,5 +250,9 @@ int main(int argc, char const** argv)
 
     application_terminate();
 
+    trace_dump();
+
+    close(quit_fd);
+
     return 0;
 }
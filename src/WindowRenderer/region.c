@@ -0,0 +1,88 @@
+#include "region.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+RegionRect region_rect_make(Vector2 position, Vector2 size)
+{
+    return (RegionRect) {
+        .x0 = position.x,
+        .y0 = position.y,
+        .x1 = position.x + size.x,
+        .y1 = position.y + size.y,
+    };
+}
+
+bool region_rect_is_empty(RegionRect rect)
+{
+    return rect.x0 >= rect.x1 || rect.y0 >= rect.y1;
+}
+
+RegionRect region_rect_intersect(RegionRect a, RegionRect b)
+{
+    return (RegionRect) {
+        .x0 = a.x0 > b.x0 ? a.x0 : b.x0,
+        .y0 = a.y0 > b.y0 ? a.y0 : b.y0,
+        .x1 = a.x1 < b.x1 ? a.x1 : b.x1,
+        .y1 = a.y1 < b.y1 ? a.y1 : b.y1,
+    };
+}
+
+void region_init(Region* region)
+{
+    memset(region, 0, sizeof(*region));
+}
+
+void region_destroy(Region* region)
+{
+    free(region->rects);
+}
+
+void region_clear(Region* region)
+{
+    region->rects_count = 0;
+}
+
+void region_add_rect(Region* region, RegionRect rect)
+{
+    if (region_rect_is_empty(rect))
+        return;
+
+    if (region->rects_count == region->rects_capacity) {
+        region->rects_capacity = region->rects_capacity == 0
+            ? 8
+            : region->rects_capacity * 2;
+        region->rects = realloc(region->rects,
+                                region->rects_capacity * sizeof(*region->rects));
+    }
+
+    region->rects[region->rects_count++] = rect;
+}
+
+void region_subtract_rect(Region* region, RegionRect rect)
+{
+    // Pieces are appended past the rectangles still to be checked, which
+    // never overlap `rect`, so they are left alone
+    size_t count = region->rects_count;
+
+    for (size_t i = 0; i < count;) {
+        RegionRect r = region->rects[i];
+        RegionRect overlap = region_rect_intersect(r, rect);
+
+        if (region_rect_is_empty(overlap)) {
+            ++i;
+            continue;
+        }
+
+        // Takes `r` out, the last rectangle to check takes its place
+        region->rects[i] = region->rects[--count];
+        region->rects[count] = region->rects[--region->rects_count];
+
+        // What's left of `r` around the overlap: full-width bands above
+        // and below, and the parts to the left and right
+        region_add_rect(region, (RegionRect) { r.x0, r.y0, r.x1, overlap.y0 });
+        region_add_rect(region, (RegionRect) { r.x0, overlap.y1, r.x1, r.y1 });
+        region_add_rect(region, (RegionRect) { r.x0, overlap.y0, overlap.x0, overlap.y1 });
+        region_add_rect(region, (RegionRect) { overlap.x1, overlap.y0, r.x1, overlap.y1 });
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+// Empty when `x0 >= x1` or `y0 >= y1`
+typedef struct {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+} RegionRect;
+
+/*
+ * An area of the screen, made of rectangles. Rectangles added with
+ * `region_add_rect` may overlap, the ones left by `region_subtract_rect`
+ * never do.
+ */
+typedef struct {
+    RegionRect* rects;
+    size_t rects_count;
+    size_t rects_capacity;
+} Region;
+
+RegionRect region_rect_make(Vector2 position, Vector2 size);
+bool region_rect_is_empty(RegionRect rect);
+RegionRect region_rect_intersect(RegionRect a, RegionRect b);
+
+void region_init(Region* region);
+void region_destroy(Region* region);
+
+void region_clear(Region* region);
+void region_add_rect(Region* region, RegionRect rect);
+
+// Removes `rect` from the region, splitting the rectangles it overlaps
+void region_subtract_rect(Region* region, RegionRect rect);
+
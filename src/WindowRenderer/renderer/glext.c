@@ -2,12 +2,18 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "log.h"
 
 PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR = NULL;
 PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR = NULL;
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = NULL;
+PFNGLDRAWARRAYSINSTANCEDEXTPROC glDrawArraysInstancedEXT = NULL;
+PFNGLVERTEXATTRIBDIVISOREXTPROC glVertexAttribDivisorEXT = NULL;
+PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR = NULL;
+PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR = NULL;
+PFNEGLWAITSYNCKHRPROC eglWaitSyncKHR = NULL;
 
 bool glext_load_extensions()
 {
@@ -37,3 +43,72 @@ bool glext_load_extensions()
 
     return true;
 }
+
+static bool has_extension(const char* extensions, const char* name)
+{
+    if (!extensions)
+        return false;
+
+    size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+        if ((found == extensions || found[-1] == ' ')
+            && (found[length] == ' ' || found[length] == '\0'))
+            return true;
+    }
+
+    return false;
+}
+
+bool glext_load_instancing()
+{
+    const char* suffix = NULL;
+
+    const char* version = (const char*)glGetString(GL_VERSION);
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (version && strncmp(version, "OpenGL ES 3", strlen("OpenGL ES 3")) == 0)
+        suffix = "";
+    else if (has_extension(extensions, "GL_EXT_instanced_arrays"))
+        suffix = "EXT";
+    else if (has_extension(extensions, "GL_ANGLE_instanced_arrays"))
+        suffix = "ANGLE";
+    else
+        return false;
+
+    char name[64];
+
+    snprintf(name, sizeof(name), "glDrawArraysInstanced%s", suffix);
+    glDrawArraysInstancedEXT = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)eglGetProcAddress(name);
+
+    snprintf(name, sizeof(name), "glVertexAttribDivisor%s", suffix);
+    glVertexAttribDivisorEXT = (PFNGLVERTEXATTRIBDIVISOREXTPROC)eglGetProcAddress(name);
+
+    if (!glDrawArraysInstancedEXT || !glVertexAttribDivisorEXT) {
+        log_log(LOG_WARNING, "Instanced drawing is advertised, but its functions "
+                             "could not be loaded");
+        glDrawArraysInstancedEXT = NULL;
+        glVertexAttribDivisorEXT = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool glext_load_native_fence_sync(EGLDisplay egl_display)
+{
+    const char* extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_ANDROID_native_fence_sync")
+        || !has_extension(extensions, "EGL_KHR_wait_sync"))
+        return false;
+
+    eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+    eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+    eglWaitSyncKHR = (PFNEGLWAITSYNCKHRPROC)eglGetProcAddress("eglWaitSyncKHR");
+
+    if (!eglCreateSyncKHR || !eglDestroySyncKHR || !eglWaitSyncKHR) {
+        log_log(LOG_WARNING, "Native fence sync is advertised, but its functions "
+                             "could not be loaded");
+        return false;
+    }
+
+    return true;
+}
@@ -11,4 +11,23 @@ extern PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 extern PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 extern PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 
+// Only loaded by `glext_load_instancing`, NULL otherwise
+extern PFNGLDRAWARRAYSINSTANCEDEXTPROC glDrawArraysInstancedEXT;
+extern PFNGLVERTEXATTRIBDIVISOREXTPROC glVertexAttribDivisorEXT;
+
+// Only loaded by `glext_load_native_fence_sync`, NULL otherwise
+extern PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+extern PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+extern PFNEGLWAITSYNCKHRPROC eglWaitSyncKHR;
+
 bool glext_load_extensions();
+
+// Loads instanced drawing, from GLES3 or from the instanced arrays
+// extensions on GLES2. Needs a current context. Returns false if instanced
+// drawing isn't supported
+bool glext_load_instancing();
+
+// Loads what's needed to make the GPU wait for sync_file fences, from
+// EGL_ANDROID_native_fence_sync and EGL_KHR_wait_sync. Returns false if
+// `egl_display` doesn't support them
+bool glext_load_native_fence_sync(EGLDisplay egl_display);
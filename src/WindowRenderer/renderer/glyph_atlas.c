@@ -0,0 +1,161 @@
+#include "glyph_atlas.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+// Keeps glyphs from picking up their neighbours when filtered
+#define GLYPH_ATLAS_PADDING 1
+
+GlyphAtlas* glyph_atlas_create(const char* font_path)
+{
+    GlyphAtlas* atlas = malloc(sizeof(*atlas));
+    memset(atlas, 0, sizeof(*atlas));
+
+    if (FT_Init_FreeType(&atlas->library) != 0) {
+        log_log(LOG_ERROR, "Could not initialize FreeType");
+        free(atlas);
+        return NULL;
+    }
+
+    if (FT_New_Face(atlas->library, font_path, 0, &atlas->face) != 0) {
+        log_log(LOG_ERROR, "Could not load font `%s`", font_path);
+        FT_Done_FreeType(atlas->library);
+        free(atlas);
+        return NULL;
+    }
+
+    unsigned char* pixels = calloc(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 4);
+    atlas->texture = texture_create(pixels, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE);
+    free(pixels);
+
+    return atlas;
+}
+
+void glyph_atlas_destroy(GlyphAtlas* atlas)
+{
+    texture_destroy(atlas->texture);
+    FT_Done_Face(atlas->face);
+    FT_Done_FreeType(atlas->library);
+    free(atlas->glyphs);
+    free(atlas);
+}
+
+static bool glyph_atlas_set_pixel_size(GlyphAtlas* atlas, int pixel_size)
+{
+    if (atlas->pixel_size == pixel_size)
+        return true;
+
+    if (FT_Set_Pixel_Sizes(atlas->face, 0, pixel_size) != 0) {
+        log_log(LOG_ERROR, "Font does not support a size of %d pixels", pixel_size);
+        return false;
+    }
+
+    atlas->pixel_size = pixel_size;
+    return true;
+}
+
+// Finds room for a bitmap of the given size. Returns false if there's none
+static bool glyph_atlas_allocate(GlyphAtlas* atlas, int width, int height, int* x, int* y)
+{
+    if (atlas->row_x + width > GLYPH_ATLAS_SIZE) {
+        atlas->row_x = 0;
+        atlas->row_y += atlas->row_height + GLYPH_ATLAS_PADDING;
+        atlas->row_height = 0;
+    }
+
+    if (width > GLYPH_ATLAS_SIZE || atlas->row_y + height > GLYPH_ATLAS_SIZE)
+        return false;
+
+    *x = atlas->row_x;
+    *y = atlas->row_y;
+
+    atlas->row_x += width + GLYPH_ATLAS_PADDING;
+    if (height > atlas->row_height)
+        atlas->row_height = height;
+
+    return true;
+}
+
+bool glyph_atlas_get(GlyphAtlas* atlas, uint32_t codepoint, int pixel_size, Glyph* glyph)
+{
+    for (size_t i = 0; i < atlas->glyphs_count; ++i) {
+        if (atlas->glyphs[i].codepoint == codepoint && atlas->glyphs[i].pixel_size == pixel_size) {
+            *glyph = atlas->glyphs[i];
+            return true;
+        }
+    }
+
+    if (atlas->full)
+        return false;
+
+    if (!glyph_atlas_set_pixel_size(atlas, pixel_size))
+        return false;
+    if (FT_Load_Char(atlas->face, codepoint, FT_LOAD_RENDER) != 0)
+        return false;
+
+    FT_GlyphSlot slot = atlas->face->glyph;
+    FT_Bitmap* bitmap = &slot->bitmap;
+
+    int x = 0;
+    int y = 0;
+    if (bitmap->width > 0 && bitmap->rows > 0) {
+        if (!glyph_atlas_allocate(atlas, bitmap->width, bitmap->rows, &x, &y)) {
+            log_log(LOG_WARNING, "Glyph atlas is full, new glyphs won't be drawn");
+            atlas->full = true;
+            return false;
+        }
+
+        unsigned char* pixels = malloc(bitmap->width * bitmap->rows * 4);
+        for (unsigned int row = 0; row < bitmap->rows; ++row) {
+            for (unsigned int column = 0; column < bitmap->width; ++column) {
+                unsigned char* pixel = &pixels[(row * bitmap->width + column) * 4];
+                pixel[0] = 0xFF;
+                pixel[1] = 0xFF;
+                pixel[2] = 0xFF;
+                pixel[3] = bitmap->buffer[row * bitmap->pitch + column];
+            }
+        }
+
+        texture_update(atlas->texture, x, y, bitmap->width, bitmap->rows, pixels);
+        free(pixels);
+    }
+
+    *glyph = (Glyph) {
+        .codepoint = codepoint,
+        .pixel_size = pixel_size,
+        .offset = { slot->bitmap_left, -slot->bitmap_top },
+        .size = { bitmap->width, bitmap->rows },
+        .advance = slot->advance.x / 64.0f,
+        .uv_top_left = {
+            (float)x / GLYPH_ATLAS_SIZE,
+            (float)y / GLYPH_ATLAS_SIZE,
+        },
+        .uv_bottom_right = {
+            (float)(x + bitmap->width) / GLYPH_ATLAS_SIZE,
+            (float)(y + bitmap->rows) / GLYPH_ATLAS_SIZE,
+        },
+    };
+
+    if (atlas->glyphs_count == atlas->glyphs_capacity) {
+        atlas->glyphs_capacity = atlas->glyphs_capacity == 0 ? 128 : atlas->glyphs_capacity * 2;
+        atlas->glyphs = realloc(atlas->glyphs, atlas->glyphs_capacity * sizeof(*atlas->glyphs));
+    }
+    atlas->glyphs[atlas->glyphs_count++] = *glyph;
+
+    return true;
+}
+
+void glyph_atlas_get_line_metrics(GlyphAtlas* atlas, int pixel_size,
+                                  float* ascent, float* descent)
+{
+    *ascent = 0.0f;
+    *descent = 0.0f;
+
+    if (!glyph_atlas_set_pixel_size(atlas, pixel_size))
+        return;
+
+    *ascent = atlas->face->size->metrics.ascender / 64.0f;
+    *descent = -atlas->face->size->metrics.descender / 64.0f;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "opengl/texture.h"
+#include "types.h"
+
+#define GLYPH_ATLAS_SIZE 512
+
+typedef struct {
+    uint32_t codepoint;
+    int pixel_size;
+
+    // Of the bitmap, relative to the pen position on the baseline
+    Vector2 offset;
+    Vector2 size;
+    float advance;
+
+    // Where the bitmap is in the atlas, top left and bottom right
+    Vector2 uv_top_left;
+    Vector2 uv_bottom_right;
+} Glyph;
+
+/*
+ * A texture holding every glyph rasterized so far, each one rasterized
+ * the first time it's used at a given size. Glyphs are white, with the
+ * coverage in the alpha channel.
+ *
+ * The texture belongs to the GL context of one output, so every output
+ * has its own atlas.
+ */
+typedef struct {
+    FT_Library library;
+    FT_Face face;
+    // Of the size set on `face`
+    int pixel_size;
+
+    Texture* texture;
+
+    // Glyphs are packed in rows, left to right, top to bottom
+    int row_x;
+    int row_y;
+    int row_height;
+
+    // Only searched when text is laid out
+    Glyph* glyphs;
+    size_t glyphs_count;
+    size_t glyphs_capacity;
+
+    bool full;
+} GlyphAtlas;
+
+// Returns NULL on error
+GlyphAtlas* glyph_atlas_create(const char* font_path);
+void glyph_atlas_destroy(GlyphAtlas* atlas);
+
+// Rasterizes the glyph if it isn't in the atlas yet. Returns false if the
+// font has no such glyph or the atlas is full
+bool glyph_atlas_get(GlyphAtlas* atlas, uint32_t codepoint, int pixel_size, Glyph* glyph);
+
+// Distances from the baseline to the top and bottom of a line of text
+void glyph_atlas_get_line_metrics(GlyphAtlas* atlas, int pixel_size,
+                                  float* ascent, float* descent);
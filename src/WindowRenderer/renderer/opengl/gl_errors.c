@@ -4,6 +4,8 @@
 
 #include "log.h"
 
+_Thread_local size_t gl_error_checks_elided = 0;
+
 void gl_clear_errors()
 {
     while (glGetError() != GL_NO_ERROR)
@@ -1,5 +1,15 @@
 #pragma once
 
+#include <stddef.h>
+
+/*
+ * Every GL call goes through `gl` or `gl_call`. With WR_GL_CHECK_ERRORS
+ * defined, errors are checked for before and after each call and logged.
+ * Otherwise the checks, which make many drivers wait for the GPU, are
+ * left out, and only counted.
+ */
+#ifdef WR_GL_CHECK_ERRORS
+
 #define gl(name, ...)                        \
     do {                                     \
         gl_clear_errors();                   \
@@ -14,5 +24,24 @@
         gl_check_errors(__FILE__, __LINE__); \
     } while (0);
 
+#else
+
+#define gl(name, ...)                  \
+    do {                               \
+        gl##name(__VA_ARGS__);         \
+        gl_error_checks_elided += 1;   \
+    } while (0);
+
+#define gl_call(...)                   \
+    do {                               \
+        __VA_ARGS__;                   \
+        gl_error_checks_elided += 1;   \
+    } while (0);
+
+#endif
+
+// Calls made without checking for errors, on this thread
+extern _Thread_local size_t gl_error_checks_elided;
+
 void gl_clear_errors();
 void gl_check_errors(const char* file, int line);
@@ -0,0 +1,135 @@
+#include "gl_state.h"
+
+#include <string.h>
+
+#include "gl_errors.h"
+
+// Bound to nothing known, so the next bind always goes through
+#define GL_STATE_UNKNOWN ((GLuint)-1)
+
+typedef struct {
+    GLuint array_buffer;
+    GLuint element_array_buffer;
+
+    GLenum active_texture;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+
+    GLuint program;
+    GLuint layout;
+
+    GLStateStats stats;
+} GLState;
+
+// Contexts are current per thread, and every output renders on its own
+static _Thread_local GLState state = {
+    .array_buffer = GL_STATE_UNKNOWN,
+    .element_array_buffer = GL_STATE_UNKNOWN,
+    .active_texture = GL_STATE_UNKNOWN,
+    .textures = {
+        GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN,
+        GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN,
+    },
+    .program = GL_STATE_UNKNOWN,
+    .layout = GL_STATE_UNKNOWN,
+};
+
+// Returns whether `*cached` has to be changed to `value`, and changes it
+static bool gl_state_update(GLuint* cached, GLuint value)
+{
+    state.stats.binds += 1;
+
+    if (*cached == value) {
+        state.stats.binds_elided += 1;
+        return false;
+    }
+
+    *cached = value;
+    return true;
+}
+
+void gl_state_invalidate(void)
+{
+    state.array_buffer = GL_STATE_UNKNOWN;
+    state.element_array_buffer = GL_STATE_UNKNOWN;
+    state.active_texture = GL_STATE_UNKNOWN;
+    for (size_t i = 0; i < GL_STATE_TEXTURE_UNITS; ++i) {
+        state.textures[i] = GL_STATE_UNKNOWN;
+    }
+    state.program = GL_STATE_UNKNOWN;
+    state.layout = GL_STATE_UNKNOWN;
+}
+
+void gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+    GLuint* cached = target == GL_ELEMENT_ARRAY_BUFFER
+        ? &state.element_array_buffer
+        : &state.array_buffer;
+
+    if (gl_state_update(cached, buffer))
+        gl(BindBuffer, target, buffer);
+}
+
+void gl_state_delete_buffer(GLuint buffer)
+{
+    gl(DeleteBuffers, 1, &buffer);
+
+    // Deleting a bound buffer unbinds it, and its ID may be handed out
+    // again
+    if (state.array_buffer == buffer)
+        state.array_buffer = 0;
+    if (state.element_array_buffer == buffer)
+        state.element_array_buffer = 0;
+    state.layout = GL_STATE_UNKNOWN;
+}
+
+void gl_state_active_texture(GLenum unit)
+{
+    if (gl_state_update(&state.active_texture, unit))
+        gl(ActiveTexture, unit);
+}
+
+void gl_state_bind_texture(GLuint texture)
+{
+    size_t unit = state.active_texture - GL_TEXTURE0;
+    if (state.active_texture == GL_STATE_UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS) {
+        gl(BindTexture, GL_TEXTURE_2D, texture);
+        return;
+    }
+
+    if (gl_state_update(&state.textures[unit], texture))
+        gl(BindTexture, GL_TEXTURE_2D, texture);
+}
+
+void gl_state_delete_texture(GLuint texture)
+{
+    gl(DeleteTextures, 1, &texture);
+
+    for (size_t i = 0; i < GL_STATE_TEXTURE_UNITS; ++i) {
+        if (state.textures[i] == texture)
+            state.textures[i] = 0;
+    }
+}
+
+void gl_state_use_program(GLuint program)
+{
+    if (gl_state_update(&state.program, program))
+        gl(UseProgram, program);
+}
+
+void gl_state_delete_program(GLuint program)
+{
+    gl(DeleteProgram, program);
+
+    if (state.program == program)
+        state.program = GL_STATE_UNKNOWN;
+}
+
+bool gl_state_use_layout(GLuint layout)
+{
+    return gl_state_update(&state.layout, layout);
+}
+
+GLStateStats gl_state_get_stats(void)
+{
+    return state.stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <GLES2/gl2.h>
+
+#define GL_STATE_TEXTURE_UNITS 8
+
+typedef struct {
+    // Binds made through the cache, and how many of them were skipped
+    // because the same thing was already bound
+    size_t binds;
+    size_t binds_elided;
+} GLStateStats;
+
+/*
+ * Keeps track of what's bound in the GL context current on this thread,
+ * so binding what's already bound doesn't reach GL. Binds and deletes of
+ * anything that may be bound have to go through here for it to stay
+ * right.
+ *
+ * The renderer is the only user of its context, so the bindings only
+ * change through here. Whatever isn't known after the context is made
+ * current for the first time is forgotten with `gl_state_invalidate`.
+ */
+
+// Forgets everything, the next binds all reach GL
+void gl_state_invalidate(void);
+
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+void gl_state_delete_buffer(GLuint buffer);
+
+void gl_state_active_texture(GLenum unit);
+// Binds to GL_TEXTURE_2D of the active unit
+void gl_state_bind_texture(GLuint texture);
+void gl_state_delete_texture(GLuint texture);
+
+void gl_state_use_program(GLuint program);
+void gl_state_delete_program(GLuint program);
+
+/*
+ * Attribute pointers stay pointed at the buffers they were specified
+ * with, so they only have to be specified again when another layout was
+ * set up since. `layout` identifies the layout, like the ID of the buffer
+ * it's for. Returns whether the attribute pointers need to be specified.
+ */
+bool gl_state_use_layout(GLuint layout);
+
+GLStateStats gl_state_get_stats(void);
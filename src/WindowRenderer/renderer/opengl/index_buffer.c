@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "gl_errors.h"
+#include "gl_state.h"
 
 IndexBuffer* index_buffer_bind_new()
 {
@@ -21,7 +22,7 @@ IndexBuffer* index_buffer_bind_new()
 
 void index_buffer_destroy(IndexBuffer* ib)
 {
-    gl(DeleteBuffers, 1, &ib->id);
+    gl_state_delete_buffer(ib->id);
     if (ib->cpu_data)
         free(ib->cpu_data);
     free(ib);
@@ -29,47 +30,53 @@ void index_buffer_destroy(IndexBuffer* ib)
 
 void index_buffer_bind(IndexBuffer* ib)
 {
-    gl(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, ib->id);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ib->id);
 }
 
 void index_buffer_unbind(IndexBuffer* ib)
 {
     (void)ib;
-    gl(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void index_buffer_clear(IndexBuffer* ib)
 {
     ib->size = 0;
+    ib->uploaded_size = 0;
 }
 
 void index_buffer_resize(IndexBuffer* ib, size_t added_byte_size)
 {
-    if (added_byte_size == 0)
+    if (ib->size + added_byte_size <= ib->capacity)
         return;
 
-    size_t new_size = ib->capacity + added_byte_size;
+    size_t new_capacity = ib->capacity == 0 ? sizeof(unsigned int) * 96 : ib->capacity * 2;
+    if (new_capacity < ib->size + added_byte_size)
+        new_capacity = ib->size + added_byte_size;
 
-    ib->cpu_data = realloc(ib->cpu_data, new_size);
-    memset(ib->cpu_data + ib->capacity, 0, added_byte_size);
-
-    gl(BufferData, GL_ELEMENT_ARRAY_BUFFER, new_size, ib->cpu_data, GL_DYNAMIC_DRAW);
-
-    ib->capacity = new_size;
+    ib->cpu_data = realloc(ib->cpu_data, new_capacity);
+    ib->capacity = new_capacity;
 }
 
 void index_buffer_push_index(IndexBuffer* ib, unsigned int index)
 {
-    if ((ib->size + sizeof(unsigned int)) > ib->capacity) {
-        index_buffer_resize(ib, sizeof(unsigned int));
-    }
+    index_buffer_resize(ib, sizeof(unsigned int));
 
-    gl(BufferSubData, GL_ELEMENT_ARRAY_BUFFER, ib->size, sizeof(unsigned int), &index);
     *(unsigned int*)(ib->cpu_data + ib->size) = index;
-
     ib->size += sizeof(unsigned int);
 }
 
+size_t index_buffer_upload(IndexBuffer* ib, GLenum usage)
+{
+    if (ib->size == ib->uploaded_size)
+        return 0;
+
+    gl(BufferData, GL_ELEMENT_ARRAY_BUFFER, ib->size, ib->cpu_data, usage);
+    ib->uploaded_size = ib->size;
+
+    return ib->size;
+}
+
 size_t index_buffer_count(IndexBuffer* ib)
 {
     return ib->size / sizeof(unsigned int);
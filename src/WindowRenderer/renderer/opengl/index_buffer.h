@@ -4,11 +4,18 @@
 
 #include <GLES2/gl2.h>
 
+/*
+ * Indices are accumulated on the CPU and sent to the GPU in one go by
+ * `index_buffer_upload`.
+ */
 typedef struct {
     GLuint id;
     size_t size;
     size_t capacity;
     unsigned char* cpu_data;
+
+    // How much of `cpu_data` the GPU already has
+    size_t uploaded_size;
 } IndexBuffer;
 
 IndexBuffer* index_buffer_bind_new();
@@ -18,7 +25,13 @@ void index_buffer_bind(IndexBuffer* ib);
 void index_buffer_unbind(IndexBuffer* ib);
 
 void index_buffer_clear(IndexBuffer* ib);
+// Makes room for at least `added_byte_size` more bytes, at least doubling
+// the capacity when it grows
 void index_buffer_resize(IndexBuffer* ib, size_t added_byte_size);
 void index_buffer_push_index(IndexBuffer* ib, unsigned int index);
 
+// Sends the indices to the bound buffer, unless nothing was pushed since
+// the last upload. Returns the number of bytes uploaded
+size_t index_buffer_upload(IndexBuffer* ib, GLenum usage);
+
 size_t index_buffer_count(IndexBuffer* ib);
@@ -0,0 +1,124 @@
+#include "instance_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../glext.h"
+#include "gl_errors.h"
+#include "gl_state.h"
+
+// Weights of the instance corners a, b, c and d at each vertex
+static const float corners[] = {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f,
+};
+
+InstanceBuffer* instance_buffer_bind_new()
+{
+    InstanceBuffer* instance_buffer = malloc(sizeof(*instance_buffer));
+    memset(instance_buffer, 0, sizeof(*instance_buffer));
+
+    gl(GenBuffers, 1, &instance_buffer->corners_id);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instance_buffer->corners_id);
+    gl(BufferData, GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+    gl(GenBuffers, 1, &instance_buffer->id);
+
+    instance_buffer_bind(instance_buffer);
+    instance_buffer_setup_layout(instance_buffer);
+
+    return instance_buffer;
+}
+
+void instance_buffer_destroy(InstanceBuffer* ib)
+{
+    if (ib->cpu_data)
+        free(ib->cpu_data);
+    gl_state_delete_buffer(ib->id);
+    gl_state_delete_buffer(ib->corners_id);
+    free(ib);
+}
+
+// Attribute locations match the ones bound by `shader_create`. Leaves the
+// instance buffer bound, for `instance_buffer_upload`
+void instance_buffer_setup_layout(InstanceBuffer* ib)
+{
+    if (gl_state_use_layout(ib->id)) {
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, ib->corners_id);
+
+        gl(EnableVertexAttribArray, 0);
+        gl(VertexAttribPointer, 0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        gl(VertexAttribDivisorEXT, 0, 0);
+
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, ib->id);
+
+        gl(EnableVertexAttribArray, 1);
+        gl(VertexAttribPointer, 1, 4, GL_FLOAT, GL_FALSE,
+           sizeof(Instance), (void*)offsetof(Instance, a_x));
+        gl(VertexAttribDivisorEXT, 1, 1);
+
+        gl(EnableVertexAttribArray, 2);
+        gl(VertexAttribPointer, 2, 4, GL_FLOAT, GL_FALSE,
+           sizeof(Instance), (void*)offsetof(Instance, c_x));
+        gl(VertexAttribDivisorEXT, 2, 1);
+
+        gl(EnableVertexAttribArray, 3);
+        gl(VertexAttribPointer, 3, 4, GL_FLOAT, GL_FALSE,
+           sizeof(Instance), (void*)offsetof(Instance, u0));
+        gl(VertexAttribDivisorEXT, 3, 1);
+
+        gl(EnableVertexAttribArray, 4);
+        gl(VertexAttribPointer, 4, 4, GL_FLOAT, GL_FALSE,
+           sizeof(Instance), (void*)offsetof(Instance, color_r));
+        gl(VertexAttribDivisorEXT, 4, 1);
+    }
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, ib->id);
+}
+
+void instance_buffer_bind(InstanceBuffer* ib)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, ib->id);
+}
+
+void instance_buffer_unbind(InstanceBuffer* ib)
+{
+    (void)ib;
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instance_buffer_clear(InstanceBuffer* ib)
+{
+    ib->size = 0;
+}
+
+void instance_buffer_push_instance(InstanceBuffer* ib, Instance instance)
+{
+    if (ib->size + sizeof(Instance) > ib->capacity) {
+        ib->capacity = ib->capacity == 0 ? sizeof(Instance) * 64 : ib->capacity * 2;
+        ib->cpu_data = realloc(ib->cpu_data, ib->capacity);
+    }
+
+    *(Instance*)(ib->cpu_data + ib->size) = instance;
+    ib->size += sizeof(Instance);
+}
+
+size_t instance_buffer_upload(InstanceBuffer* ib)
+{
+    if (ib->size == 0)
+        return 0;
+
+    if (ib->gpu_capacity < ib->capacity)
+        ib->gpu_capacity = ib->capacity;
+    gl(BufferData, GL_ARRAY_BUFFER, ib->gpu_capacity, NULL, GL_STREAM_DRAW);
+    gl(BufferSubData, GL_ARRAY_BUFFER, 0, ib->size, ib->cpu_data);
+
+    return ib->size;
+}
+
+size_t instance_buffer_count(InstanceBuffer* ib)
+{
+    return ib->size / sizeof(Instance);
+}
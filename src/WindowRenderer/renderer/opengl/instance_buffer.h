@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <GLES2/gl2.h>
+
+/*
+ * One quad, drawn over the 4 vertices of the corner buffer. Corners get
+ * the positions a, b, c and d and the texture coordinates (u0, v0),
+ * (u1, v0), (u1, v1) and (u0, v1), in that order.
+ */
+typedef struct __attribute__((__packed__)) {
+    float a_x, a_y, b_x, b_y;
+    float c_x, c_y, d_x, d_y;
+    float u0, v0, u1, v1;
+    float color_r, color_g, color_b, color_a;
+} Instance;
+
+/*
+ * Instances are accumulated on the CPU and sent to the GPU in one go by
+ * `instance_buffer_upload`, like `VertexBuffer`. The corner buffer never
+ * changes.
+ */
+typedef struct {
+    GLuint id;
+    size_t size;
+    size_t capacity;
+    unsigned char* cpu_data;
+
+    // Size of the GPU-side storage
+    size_t gpu_capacity;
+
+    GLuint corners_id;
+} InstanceBuffer;
+
+// Needs instanced drawing, see `glext_load_instancing`
+InstanceBuffer* instance_buffer_bind_new();
+void instance_buffer_destroy(InstanceBuffer* ib);
+
+void instance_buffer_setup_layout(InstanceBuffer* ib);
+
+void instance_buffer_bind(InstanceBuffer* ib);
+void instance_buffer_unbind(InstanceBuffer* ib);
+
+void instance_buffer_clear(InstanceBuffer* ib);
+void instance_buffer_push_instance(InstanceBuffer* ib, Instance instance);
+
+// Sends the accumulated instances to the buffer, orphaning its previous
+// contents. Returns the number of bytes uploaded
+size_t instance_buffer_upload(InstanceBuffer* ib);
+
+size_t instance_buffer_count(InstanceBuffer* ib);
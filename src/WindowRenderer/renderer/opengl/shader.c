@@ -8,6 +8,7 @@
 #include <GLES2/gl2.h>
 
 #include "gl_errors.h"
+#include "gl_state.h"
 #include "log.h"
 
 static GLuint compile_shader(GLenum type, const char* source)
@@ -40,23 +41,52 @@ static GLuint compile_shader(GLenum type, const char* source)
     return id;
 }
 
-static int shader_get_uniform_location(Shader* shader, const char* name)
+static void shader_load_uniforms(Shader* shader)
 {
-    for (size_t i = 0; i < shader->uniform_count; ++i) {
-        if (strcmp(shader->uniforms[i].name, name) == 0) {
-            return shader->uniforms[i].location;
-        }
+    GLint count = 0;
+    GLint max_name_length = 0;
+    gl(GetProgramiv, shader->id, GL_ACTIVE_UNIFORMS, &count);
+    gl(GetProgramiv, shader->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    if (count <= 0)
+        return;
+
+    shader->uniforms = malloc(count * sizeof(*shader->uniforms));
+    memset(shader->uniforms, 0, count * sizeof(*shader->uniforms));
+
+    char* name = alloca(max_name_length + 1);
+
+    for (GLint i = 0; i < count; ++i) {
+        GLint size;
+        GLenum type;
+        gl(GetActiveUniform, shader->id, i, max_name_length + 1, NULL, &size, &type, name);
+
+        Uniform* uniform = &shader->uniforms[shader->uniform_count++];
+        uniform->name = strdup(name);
+        gl_call(uniform->location = glGetUniformLocation(shader->id, name));
     }
+}
 
-    int location;
-    gl_call(location = glGetUniformLocation(shader->id, name));
+/*
+ * Records that the uniform is set to `value`. Returns false if it already
+ * was, in which case the GL call is skipped.
+ */
+static bool shader_update_uniform(Shader* shader, int uniform, const void* value, size_t size)
+{
+    if (uniform < 0)
+        return false;
 
-    shader->uniforms[shader->uniform_count++] = (Uniform) {
-        .name = name,
-        .location = location,
-    };
+    Uniform* u = &shader->uniforms[uniform];
+    shader->uniform_sets += 1;
+
+    if (u->has_value && memcmp(&u->value, value, size) == 0) {
+        shader->uniform_sets_skipped += 1;
+        return false;
+    }
 
-    return location;
+    memcpy(&u->value, value, size);
+    u->has_value = true;
+    return true;
 }
 
 Shader* shader_create(const char* vertex_source, const char* fragment_source)
@@ -69,14 +99,14 @@ Shader* shader_create(const char* vertex_source, const char* fragment_source)
     GLuint vert_shader = compile_shader(GL_VERTEX_SHADER, vertex_source);
     if (vert_shader == 0) {
         log_log(LOG_ERROR, "Failed to compile vertex shader");
-        gl(DeleteProgram, shader->id);
+        gl_state_delete_program(shader->id);
         return NULL;
     }
 
     GLuint frag_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
     if (frag_shader == 0) {
         log_log(LOG_ERROR, "Failed to compile fragment shader");
-        gl(DeleteProgram, shader->id);
+        gl_state_delete_program(shader->id);
         return NULL;
     }
 
@@ -87,63 +117,94 @@ Shader* shader_create(const char* vertex_source, const char* fragment_source)
     gl(BindAttribLocation, shader->id, 1, "a_tex_coord");
     gl(BindAttribLocation, shader->id, 2, "a_color");
 
+    // Attributes of instanced shaders, see `instance_buffer_setup_layout`
+    gl(BindAttribLocation, shader->id, 0, "a_corner");
+    gl(BindAttribLocation, shader->id, 1, "a_position_ab");
+    gl(BindAttribLocation, shader->id, 2, "a_position_cd");
+    gl(BindAttribLocation, shader->id, 3, "a_tex_rect");
+    gl(BindAttribLocation, shader->id, 4, "a_instance_color");
+
     gl(LinkProgram, shader->id);
     gl(ValidateProgram, shader->id);
 
     gl(DeleteShader, vert_shader);
     gl(DeleteShader, frag_shader);
 
+    shader_load_uniforms(shader);
+
     return shader;
 }
 
 void shader_destroy(Shader* shader)
 {
-    gl(DeleteProgram, shader->id);
+    for (size_t i = 0; i < shader->uniform_count; ++i) {
+        free(shader->uniforms[i].name);
+    }
+    free(shader->uniforms);
+
+    gl_state_delete_program(shader->id);
     free(shader);
 }
 
 void shader_bind(Shader* shader)
 {
-    gl(UseProgram, shader->id);
+    gl_state_use_program(shader->id);
 }
 
 void shader_unbind(Shader* shader)
 {
     (void)shader;
-    gl(UseProgram, 0);
+    gl_state_use_program(0);
+}
+
+int shader_get_uniform(Shader* shader, const char* name)
+{
+    for (size_t i = 0; i < shader->uniform_count; ++i) {
+        if (strcmp(shader->uniforms[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
 }
 
-void shader_set_uniform_1i(Shader* shader, const char* name, int x)
+void shader_set_uniform_1i(Shader* shader, int uniform, int x)
 {
-    gl(Uniform1i, shader_get_uniform_location(shader, name), x);
+    int value[] = { x };
+    if (shader_update_uniform(shader, uniform, value, sizeof(value)))
+        gl(Uniform1i, shader->uniforms[uniform].location, x);
 }
 
-void shader_set_uniform_1f(Shader* shader, const char* name, float x)
+void shader_set_uniform_1f(Shader* shader, int uniform, float x)
 {
-    gl(Uniform1f, shader_get_uniform_location(shader, name), x);
+    float value[] = { x };
+    if (shader_update_uniform(shader, uniform, value, sizeof(value)))
+        gl(Uniform1f, shader->uniforms[uniform].location, x);
 }
 
-void shader_set_uniform_2f(Shader* shader, const char* name, float x, float y)
+void shader_set_uniform_2f(Shader* shader, int uniform, float x, float y)
 {
-    gl(Uniform2f, shader_get_uniform_location(shader, name),
-       x, y);
+    float value[] = { x, y };
+    if (shader_update_uniform(shader, uniform, value, sizeof(value)))
+        gl(Uniform2f, shader->uniforms[uniform].location, x, y);
 }
 
-void shader_set_uniform_3f(Shader* shader, const char* name,
+void shader_set_uniform_3f(Shader* shader, int uniform,
                            float x, float y, float z)
 {
-    gl(Uniform3f, shader_get_uniform_location(shader, name),
-       x, y, z);
+    float value[] = { x, y, z };
+    if (shader_update_uniform(shader, uniform, value, sizeof(value)))
+        gl(Uniform3f, shader->uniforms[uniform].location, x, y, z);
 }
 
-void shader_set_uniform_4f(Shader* shader, const char* name,
+void shader_set_uniform_4f(Shader* shader, int uniform,
                            float x, float y, float z, float w)
 {
-    gl(Uniform4f, shader_get_uniform_location(shader, name),
-       x, y, z, w);
+    float value[] = { x, y, z, w };
+    if (shader_update_uniform(shader, uniform, value, sizeof(value)))
+        gl(Uniform4f, shader->uniforms[uniform].location, x, y, z, w);
 }
 
-void shader_set_uniform_mat4x4f(Shader* shader, const char* name,
+void shader_set_uniform_mat4x4f(Shader* shader, int uniform,
                                 float m0, float m4, float m8, float m12,
                                 float m1, float m5, float m9, float m13,
                                 float m2, float m6, float m10, float m14,
@@ -155,5 +216,6 @@ void shader_set_uniform_mat4x4f(Shader* shader, const char* name,
         m2, m6, m10, m14,
         m3, m7, m11, m15
     };
-    gl(UniformMatrix4fv, shader_get_uniform_location(shader, name), 1, GL_FALSE, matrix);
+    if (shader_update_uniform(shader, uniform, matrix, sizeof(matrix)))
+        gl(UniformMatrix4fv, shader->uniforms[uniform].location, 1, GL_FALSE, matrix);
 }
@@ -5,18 +5,32 @@
 
 #include <GLES2/gl2.h>
 
+/*
+ * An active uniform of the shader. What it was last set to is kept, so
+ * setting it to the same value again doesn't reach GL.
+ */
 typedef struct {
-    int location;
-    const char* name;
+    char* name;
+    GLint location;
+
+    bool has_value;
+    union {
+        int i[4];
+        float f[16];
+    } value;
 } Uniform;
 
-#define MAX_UNIFORMS 1024
-
 typedef struct {
     GLuint id;
 
-    Uniform uniforms[MAX_UNIFORMS];
+    // Looked up when the shader is linked
+    Uniform* uniforms;
     size_t uniform_count;
+
+    // How many times uniforms were set, and how many of those were
+    // skipped because nothing changed
+    size_t uniform_sets;
+    size_t uniform_sets_skipped;
 } Shader;
 
 // Returns NULL on error
@@ -26,14 +40,19 @@ void shader_destroy(Shader* shader);
 void shader_bind(Shader* shader);
 void shader_unbind(Shader* shader);
 
-void shader_set_uniform_1i(Shader* shader, const char* name, int x);
-void shader_set_uniform_1f(Shader* shader, const char* name, float x);
-void shader_set_uniform_2f(Shader* shader, const char* name, float x, float y);
-void shader_set_uniform_3f(Shader* shader, const char* name,
+// Returns the handle of the uniform named `name`, to be passed to the
+// setters, or -1 if the shader doesn't use it. Look it up once and keep it
+int shader_get_uniform(Shader* shader, const char* name);
+
+// The shader must be bound. Handles of -1 are ignored
+void shader_set_uniform_1i(Shader* shader, int uniform, int x);
+void shader_set_uniform_1f(Shader* shader, int uniform, float x);
+void shader_set_uniform_2f(Shader* shader, int uniform, float x, float y);
+void shader_set_uniform_3f(Shader* shader, int uniform,
                            float x, float y, float z);
-void shader_set_uniform_4f(Shader* shader, const char* name,
+void shader_set_uniform_4f(Shader* shader, int uniform,
                            float x, float y, float z, float w);
-void shader_set_uniform_mat4x4f(Shader* shader, const char* name,
+void shader_set_uniform_mat4x4f(Shader* shader, int uniform,
                                 float m0, float m4, float m8, float m12,
                                 float m1, float m5, float m9, float m13,
                                 float m2, float m6, float m10, float m14,
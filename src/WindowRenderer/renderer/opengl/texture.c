@@ -5,6 +5,7 @@
 
 #include "../glext.h"
 #include "gl_errors.h"
+#include "gl_state.h"
 
 Texture* texture_create(unsigned char* pixels, int width, int height)
 {
@@ -16,7 +17,7 @@ Texture* texture_create(unsigned char* pixels, int width, int height)
 
     gl(GenTextures, 1, &texture->id);
 
-    gl(BindTexture, GL_TEXTURE_2D, texture->id);
+    gl_state_bind_texture(texture->id);
 
     gl(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     gl(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -26,7 +27,7 @@ Texture* texture_create(unsigned char* pixels, int width, int height)
     gl(TexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, width, height,
        0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
-    gl(BindTexture, GL_TEXTURE_2D, 0);
+    gl_state_bind_texture(0);
 
     return texture;
 }
@@ -41,7 +42,7 @@ Texture* texture_create_from_egl_imagekhr(EGLImageKHR egl_image, int width, int
 
     gl(GenTextures, 1, &texture->id);
 
-    gl(BindTexture, GL_TEXTURE_2D, texture->id);
+    gl_state_bind_texture(texture->id);
 
     gl(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     gl(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -50,26 +51,35 @@ Texture* texture_create_from_egl_imagekhr(EGLImageKHR egl_image, int width, int
 
     gl(EGLImageTargetTexture2DOES, GL_TEXTURE_2D, egl_image);
 
-    gl(BindTexture, GL_TEXTURE_2D, 0);
+    gl_state_bind_texture(0);
 
     return texture;
 }
 
+void texture_update(Texture* texture, int x, int y, int width, int height,
+                    unsigned char* pixels)
+{
+    gl_state_bind_texture(texture->id);
+    gl(TexSubImage2D, GL_TEXTURE_2D, 0, x, y, width, height,
+       GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    gl_state_bind_texture(0);
+}
+
 void texture_destroy(Texture* texture)
 {
-    gl(DeleteTextures, 1, &texture->id);
+    gl_state_delete_texture(texture->id);
     free(texture);
 }
 
 void texture_bind(Texture* texture, int slot)
 {
-    gl(ActiveTexture, GL_TEXTURE0 + slot);
-    gl(BindTexture, GL_TEXTURE_2D, texture->id);
+    gl_state_active_texture(GL_TEXTURE0 + slot);
+    gl_state_bind_texture(texture->id);
 }
 
 void texture_unbind(Texture* texture)
 {
     (void)texture;
-    gl(BindTexture, GL_TEXTURE_2D, 0);
-    gl(ActiveTexture, GL_TEXTURE0);
+    gl_state_bind_texture(0);
+    gl_state_active_texture(GL_TEXTURE0);
 }
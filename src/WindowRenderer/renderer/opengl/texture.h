@@ -14,6 +14,10 @@ typedef struct {
 Texture* texture_create(unsigned char* pixels, int width, int height);
 Texture* texture_create_from_egl_imagekhr(EGLImageKHR egl_image, int width, int height);
 
+// Replaces the pixels of the given area with `pixels`, tightly packed RGBA
+void texture_update(Texture* texture, int x, int y, int width, int height,
+                    unsigned char* pixels);
+
 void texture_bind(Texture* texture, int slot);
 void texture_unbind(Texture* texture);
 void texture_destroy(Texture* texture);
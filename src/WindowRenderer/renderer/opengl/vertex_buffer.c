@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "gl_errors.h"
+#include "gl_state.h"
 
 VertexBuffer* vertex_buffer_bind_new()
 {
@@ -24,13 +25,15 @@ void vertex_buffer_destroy(VertexBuffer* vb)
 {
     if (vb->cpu_data)
         free(vb->cpu_data);
-    gl(DeleteBuffers, 1, &vb->id);
+    gl_state_delete_buffer(vb->id);
     free(vb);
 }
 
 void vertex_buffer_setup_layout(VertexBuffer* vb)
 {
-    (void)vb;
+    // Still pointing at this buffer
+    if (!gl_state_use_layout(vb->id))
+        return;
 
     gl(EnableVertexAttribArray, 0);
     gl(VertexAttribPointer, 0, 2, GL_FLOAT, GL_FALSE,
@@ -47,13 +50,13 @@ void vertex_buffer_setup_layout(VertexBuffer* vb)
 
 void vertex_buffer_bind(VertexBuffer* vb)
 {
-    gl(BindBuffer, GL_ARRAY_BUFFER, vb->id);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, vb->id);
 }
 
 void vertex_buffer_unbind(VertexBuffer* vb)
 {
     (void)vb;
-    gl(BindBuffer, GL_ARRAY_BUFFER, 0);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
 }
 
 void vertex_buffer_clear(VertexBuffer* vb)
@@ -63,31 +66,40 @@ void vertex_buffer_clear(VertexBuffer* vb)
 
 void vertex_buffer_resize(VertexBuffer* vb, size_t added_size)
 {
-    if (added_size == 0)
+    if (vb->size + added_size <= vb->capacity)
         return;
 
-    size_t new_size = vb->capacity + added_size;
-
-    vb->cpu_data = realloc(vb->cpu_data, new_size);
-    memset(vb->cpu_data + vb->capacity, 0, added_size);
+    size_t new_capacity = vb->capacity == 0 ? sizeof(Vertex) * 64 : vb->capacity * 2;
+    if (new_capacity < vb->size + added_size)
+        new_capacity = vb->size + added_size;
 
-    gl(BufferData, GL_ARRAY_BUFFER, new_size, vb->cpu_data, GL_DYNAMIC_DRAW);
-
-    vb->capacity = new_size;
+    vb->cpu_data = realloc(vb->cpu_data, new_capacity);
+    vb->capacity = new_capacity;
 }
 
 void vertex_buffer_push_vertex(VertexBuffer* vb, Vertex vertex)
 {
-    if ((vb->size + sizeof(Vertex)) > vb->capacity) {
-        vertex_buffer_resize(vb, sizeof(Vertex));
-    }
+    vertex_buffer_resize(vb, sizeof(Vertex));
 
-    gl(BufferSubData, GL_ARRAY_BUFFER, vb->size, sizeof(Vertex), &vertex);
     *(Vertex*)(vb->cpu_data + vb->size) = vertex;
-
     vb->size += sizeof(Vertex);
 }
 
+size_t vertex_buffer_upload(VertexBuffer* vb)
+{
+    if (vb->size == 0)
+        return 0;
+
+    // Reallocating the storage every time lets the driver hand out fresh
+    // memory instead of waiting for draws still reading the old one
+    if (vb->gpu_capacity < vb->capacity)
+        vb->gpu_capacity = vb->capacity;
+    gl(BufferData, GL_ARRAY_BUFFER, vb->gpu_capacity, NULL, GL_STREAM_DRAW);
+    gl(BufferSubData, GL_ARRAY_BUFFER, 0, vb->size, vb->cpu_data);
+
+    return vb->size;
+}
+
 size_t vertex_buffer_count(VertexBuffer* vb)
 {
     return vb->size / sizeof(Vertex);
@@ -10,11 +10,18 @@ typedef struct __attribute__((__packed__)) {
     float color_r, color_g, color_b, color_a;
 } Vertex;
 
+/*
+ * Vertices are accumulated on the CPU and sent to the GPU in one go by
+ * `vertex_buffer_upload`.
+ */
 typedef struct {
     GLuint id;
     size_t size;
     size_t capacity;
     unsigned char* cpu_data;
+
+    // Size of the GPU-side storage
+    size_t gpu_capacity;
 } VertexBuffer;
 
 VertexBuffer* vertex_buffer_bind_new();
@@ -26,7 +33,14 @@ void vertex_buffer_bind(VertexBuffer* vb);
 void vertex_buffer_unbind(VertexBuffer* vb);
 
 void vertex_buffer_clear(VertexBuffer* vb);
+// Makes room for at least `added_size` more bytes, at least doubling the
+// capacity when it grows
 void vertex_buffer_resize(VertexBuffer* vb, size_t added_size);
 void vertex_buffer_push_vertex(VertexBuffer* vb, Vertex vertex);
 
+// Sends the accumulated vertices to the bound buffer, orphaning its
+// previous contents so the GPU can keep reading them. Returns the number
+// of bytes uploaded
+size_t vertex_buffer_upload(VertexBuffer* vb);
+
 size_t vertex_buffer_count(VertexBuffer* vb);
@@ -1,9 +1,13 @@
 #include "renderer.h"
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "glext.h"
+#include "log.h"
 #include "opengl/gl_errors.h"
+#include "opengl/gl_state.h"
 
 typedef struct {
     float m0, m4, m8, m12;
@@ -52,16 +56,213 @@ static void sort_triangle(Vector2* a, Vector2* b, Vector2* c)
     }
 }
 
+// Only recomputed when the screen size changes
+static void renderer_update_mvp(Renderer* renderer)
+{
+    if (renderer->mvp_width == renderer->screen_width
+        && renderer->mvp_height == renderer->screen_height)
+        return;
+
+    Matrix mvp_mat = make_orthogonal_matrix(0, renderer->screen_width,
+                                            0, renderer->screen_height);
+
+    shader_set_uniform_mat4x4f(renderer->default_shader, renderer->mvp_uniform,
+                               mvp_mat.m0, mvp_mat.m4, mvp_mat.m8, mvp_mat.m12,
+                               mvp_mat.m1, mvp_mat.m5, mvp_mat.m9, mvp_mat.m13,
+                               mvp_mat.m2, mvp_mat.m6, mvp_mat.m10, mvp_mat.m14,
+                               mvp_mat.m3, mvp_mat.m7, mvp_mat.m11, mvp_mat.m15);
+
+    renderer->mvp_width = renderer->screen_width;
+    renderer->mvp_height = renderer->screen_height;
+}
+
+// Textures are always sampled from slot 0, see `renderer_create`
 static void renderer_bind_texture(Renderer* renderer, Texture* texture)
 {
+    (void)renderer;
     texture_bind(texture, 0);
-    shader_set_uniform_1i(renderer->default_shader, "u_texture_slot", 0);
 }
 
-static void renderer_clear_buffers(Renderer* renderer)
+/*
+ * Everything is drawn as quads of 4 vertices, so the indices never
+ * change. They are only extended when a batch has more quads than ever
+ * before.
+ */
+static void renderer_reserve_quad_indices(Renderer* renderer, size_t quad_count)
 {
+    IndexBuffer* index_buffer = renderer->index_buffer;
+
+    size_t index_count = index_buffer_count(index_buffer);
+    if (quad_count * 6 <= index_count)
+        return;
+
+    size_t new_quad_count = index_count / 6 * 2;
+    if (new_quad_count < quad_count)
+        new_quad_count = quad_count;
+
+    for (unsigned int first = index_count / 6 * 4; first < new_quad_count * 4; first += 4) {
+        // First triangle
+        index_buffer_push_index(index_buffer, first + 0);
+        index_buffer_push_index(index_buffer, first + 1);
+        index_buffer_push_index(index_buffer, first + 2);
+
+        // Second triangle
+        index_buffer_push_index(index_buffer, first + 2);
+        index_buffer_push_index(index_buffer, first + 3);
+        index_buffer_push_index(index_buffer, first + 0);
+    }
+
+    renderer->stats.uploaded_bytes += index_buffer_upload(index_buffer, GL_STATIC_DRAW);
+}
+
+static void renderer_flush(Renderer* renderer)
+{
+    if (renderer->instance_buffer) {
+        size_t instance_count = instance_buffer_count(renderer->instance_buffer);
+        if (instance_count == 0)
+            return;
+
+        renderer->stats.uploaded_bytes += instance_buffer_upload(renderer->instance_buffer);
+
+        renderer_bind_texture(renderer, renderer->batch_texture);
+
+        gl(DrawArraysInstancedEXT, GL_TRIANGLE_FAN, 0, 4, instance_count);
+
+        renderer->stats.draw_calls += 1;
+        renderer->stats.instances += instance_count;
+
+        instance_buffer_clear(renderer->instance_buffer);
+        return;
+    }
+
+    size_t quad_count = vertex_buffer_count(renderer->vertex_buffer) / 4;
+    if (quad_count == 0)
+        return;
+
+    renderer_reserve_quad_indices(renderer, quad_count);
+    renderer->stats.uploaded_bytes += vertex_buffer_upload(renderer->vertex_buffer);
+
+    renderer_bind_texture(renderer, renderer->batch_texture);
+
+    gl(DrawElements, GL_TRIANGLES, quad_count * 6, GL_UNSIGNED_INT, NULL);
+
+    renderer->stats.draw_calls += 1;
+    renderer->stats.vertices += quad_count * 4;
+
     vertex_buffer_clear(renderer->vertex_buffer);
-    index_buffer_clear(renderer->index_buffer);
+}
+
+// Flushes the batch first if it was drawing with another texture
+static void renderer_use_texture(Renderer* renderer, Texture* texture)
+{
+    if (renderer->batch_texture != texture) {
+        renderer_flush(renderer);
+        renderer->batch_texture = texture;
+    }
+}
+
+/*
+ * Batches the quad a-b-c-d, drawn with `texture`. The corners get texture
+ * coordinates (uv0.x, uv0.y), (uv1.x, uv0.y), (uv1.x, uv1.y) and
+ * (uv0.x, uv1.y), in that order.
+ */
+static void renderer_push_quad(Renderer* renderer, Texture* texture,
+                               Vector2 a, Vector2 b, Vector2 c, Vector2 d,
+                               Vector2 uv0, Vector2 uv1, Vector4 color)
+{
+    renderer_use_texture(renderer, texture);
+
+    if (renderer->instance_buffer) {
+        instance_buffer_push_instance(renderer->instance_buffer, (Instance) {
+                                                                     V2X(a),
+                                                                     V2X(b),
+                                                                     V2X(c),
+                                                                     V2X(d),
+                                                                     V2X(uv0),
+                                                                     V2X(uv1),
+                                                                     V4X(color),
+                                                                 });
+        return;
+    }
+
+    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
+                                                           V2X(a),
+                                                           uv0.x,
+                                                           uv0.y,
+                                                           V4X(color),
+                                                       });
+    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
+                                                           V2X(b),
+                                                           uv1.x,
+                                                           uv0.y,
+                                                           V4X(color),
+                                                       });
+    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
+                                                           V2X(c),
+                                                           uv1.x,
+                                                           uv1.y,
+                                                           V4X(color),
+                                                       });
+    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
+                                                           V2X(d),
+                                                           uv0.x,
+                                                           uv1.y,
+                                                           V4X(color),
+                                                       });
+}
+
+/*
+ * Batches a rectangle showing the part of the texture between the given
+ * texture coordinates, cut down to the crop.
+ */
+static void renderer_push_rectangle(Renderer* renderer, Texture* texture,
+                                    Vector2 position, Vector2 size,
+                                    Vector2 uv_top_left, Vector2 uv_bottom_right,
+                                    Vector4 color)
+{
+    float x0 = position.x;
+    float y0 = position.y;
+    float x1 = position.x + size.x;
+    float y1 = position.y + size.y;
+
+    if (renderer->crop_enabled) {
+        float cx0 = x0 > renderer->crop_min.x ? x0 : renderer->crop_min.x;
+        float cy0 = y0 > renderer->crop_min.y ? y0 : renderer->crop_min.y;
+        float cx1 = x1 < renderer->crop_max.x ? x1 : renderer->crop_max.x;
+        float cy1 = y1 < renderer->crop_max.y ? y1 : renderer->crop_max.y;
+
+        if (cx0 >= cx1 || cy0 >= cy1)
+            return;
+
+        Vector2 uv_scale = {
+            (uv_bottom_right.x - uv_top_left.x) / size.x,
+            (uv_bottom_right.y - uv_top_left.y) / size.y,
+        };
+
+        uv_bottom_right = (Vector2) {
+            uv_top_left.x + (cx1 - x0) * uv_scale.x,
+            uv_top_left.y + (cy1 - y0) * uv_scale.y,
+        };
+        uv_top_left = (Vector2) {
+            uv_top_left.x + (cx0 - x0) * uv_scale.x,
+            uv_top_left.y + (cy0 - y0) * uv_scale.y,
+        };
+
+        x0 = cx0;
+        y0 = cy0;
+        x1 = cx1;
+        y1 = cy1;
+    }
+
+    Vector2 a = { x0, y1 };
+    Vector2 b = { x1, y1 };
+    Vector2 c = { x1, y0 };
+    Vector2 d = { x0, y0 };
+
+    renderer_push_quad(renderer, texture, a, b, c, d,
+                       (Vector2) { uv_top_left.x, uv_bottom_right.y },
+                       (Vector2) { uv_bottom_right.x, uv_top_left.y },
+                       color);
 }
 
 Renderer* renderer_create(int width, int height)
@@ -72,6 +273,9 @@ Renderer* renderer_create(int width, int height)
     renderer->screen_width = width;
     renderer->screen_height = height;
 
+    // The context may be new to this thread
+    gl_state_invalidate();
+
     renderer->vertex_array = vertex_array_create();
 
     renderer->vertex_buffer = vertex_array_bind_vertex_buffer(renderer->vertex_array);
@@ -97,6 +301,34 @@ Renderer* renderer_create(int width, int height)
                                        "    v_color = a_color;\n"
                                        "}";
 
+    // Picks the corners of the quad with the weights in `a_corner`, see
+    // `Instance`
+    const char* instanced_vertex_shader_source = "#version 100\n"
+                                                 ""
+                                                 "attribute vec4 a_corner;\n"
+                                                 "attribute vec4 a_position_ab;\n"
+                                                 "attribute vec4 a_position_cd;\n"
+                                                 "attribute vec4 a_tex_rect;\n"
+                                                 "attribute vec4 a_instance_color;\n"
+                                                 ""
+                                                 "varying vec2 v_tex_coord;\n"
+                                                 "varying vec4 v_color;\n"
+                                                 ""
+                                                 "uniform mat4 u_MVP;\n"
+                                                 ""
+                                                 "void main()\n"
+                                                 "{\n"
+                                                 "    vec2 position = a_corner.x * a_position_ab.xy\n"
+                                                 "                  + a_corner.y * a_position_ab.zw\n"
+                                                 "                  + a_corner.z * a_position_cd.xy\n"
+                                                 "                  + a_corner.w * a_position_cd.zw;\n"
+                                                 "    vec2 tex_weight = vec2(a_corner.y + a_corner.z,\n"
+                                                 "                           a_corner.z + a_corner.w);\n"
+                                                 "    gl_Position = vec4(position, 0.0, 1.0) * u_MVP;\n"
+                                                 "    v_tex_coord = mix(a_tex_rect.xy, a_tex_rect.zw, tex_weight);\n"
+                                                 "    v_color = a_instance_color;\n"
+                                                 "}";
+
     const char* fragment_shader_source = "#version 100\n"
                                          ""
                                          "precision mediump float;\n"
@@ -112,21 +344,32 @@ Renderer* renderer_create(int width, int height)
                                          "    gl_FragColor = tex_color * v_color;\n"
                                          "}";
 
-    renderer->default_shader = shader_create(vertex_shader_source, fragment_shader_source);
+    // The whole batch then takes one small instance per quad, instead of
+    // 4 vertices and 6 indices
+    if (glext_load_instancing()) {
+        renderer->default_shader = shader_create(instanced_vertex_shader_source,
+                                                 fragment_shader_source);
+        if (renderer->default_shader) {
+            renderer->instance_buffer = instance_buffer_bind_new();
+            instance_buffer_unbind(renderer->instance_buffer);
+        } else {
+            log_log(LOG_WARNING, "Failed to create the instanced shader, "
+                                 "falling back to drawing vertices");
+        }
+    }
+
+    if (!renderer->default_shader)
+        renderer->default_shader = shader_create(vertex_shader_source, fragment_shader_source);
     if (!renderer->default_shader) {
         return NULL;
     }
 
-    shader_bind(renderer->default_shader);
-
-    Matrix mvp_mat = make_orthogonal_matrix(0, width, 0, height);
-
-    shader_set_uniform_mat4x4f(renderer->default_shader, "u_MVP",
-                               mvp_mat.m0, mvp_mat.m4, mvp_mat.m8, mvp_mat.m12,
-                               mvp_mat.m1, mvp_mat.m5, mvp_mat.m9, mvp_mat.m13,
-                               mvp_mat.m2, mvp_mat.m6, mvp_mat.m10, mvp_mat.m14,
-                               mvp_mat.m3, mvp_mat.m7, mvp_mat.m11, mvp_mat.m15);
+    renderer->mvp_uniform = shader_get_uniform(renderer->default_shader, "u_MVP");
+    int texture_slot_uniform = shader_get_uniform(renderer->default_shader, "u_texture_slot");
 
+    shader_bind(renderer->default_shader);
+    shader_set_uniform_1i(renderer->default_shader, texture_slot_uniform, 0);
+    renderer_update_mvp(renderer);
     shader_unbind(renderer->default_shader);
 
     unsigned char pixels[] = { 0xFF, 0xFF, 0xFF, 0xFF };
@@ -137,7 +380,20 @@ Renderer* renderer_create(int width, int height)
 
 void renderer_destroy(Renderer* renderer)
 {
+    if (renderer->frames != 0) {
+        RendererStats* total = &renderer->total_stats;
+        log_log(LOG_INFO, "Renderer: %zu frames, %.1f draws and %.1f KiB uploaded per frame, "
+                          "%zu binds elided, %zu GL error checks elided",
+                renderer->frames,
+                (double)total->draw_calls / renderer->frames,
+                (double)total->uploaded_bytes / renderer->frames / 1024.0,
+                total->binds_elided,
+                total->error_checks_elided);
+    }
+
     vertex_array_destroy(renderer->vertex_array);
+    if (renderer->instance_buffer)
+        instance_buffer_destroy(renderer->instance_buffer);
     shader_destroy(renderer->default_shader);
     texture_destroy(renderer->default_texture);
     free(renderer);
@@ -150,9 +406,93 @@ Vector2 renderer_get_screen_size(Renderer* renderer)
 
 void renderer_begin_drawing(Renderer* renderer)
 {
-    vertex_array_bind(renderer->vertex_array);
+    if (renderer->instance_buffer)
+        instance_buffer_setup_layout(renderer->instance_buffer);
+    else
+        vertex_array_bind(renderer->vertex_array);
     shader_bind(renderer->default_shader);
-    renderer_bind_texture(renderer, renderer->default_texture);
+    renderer_update_mvp(renderer);
+
+    renderer->batch_texture = renderer->default_texture;
+    renderer->crop_enabled = false;
+    memset(&renderer->stats, 0, sizeof(renderer->stats));
+    renderer->binds_elided_at_begin = gl_state_get_stats().binds_elided;
+    renderer->error_checks_elided_at_begin = gl_error_checks_elided;
+}
+
+void renderer_end_drawing(Renderer* renderer)
+{
+    renderer_flush(renderer);
+
+    renderer->stats.binds_elided = gl_state_get_stats().binds_elided
+        - renderer->binds_elided_at_begin;
+    renderer->stats.error_checks_elided = gl_error_checks_elided
+        - renderer->error_checks_elided_at_begin;
+    renderer->frame_stats = renderer->stats;
+
+    RendererStats* total = &renderer->total_stats;
+    total->draw_calls += renderer->stats.draw_calls;
+    total->vertices += renderer->stats.vertices;
+    total->instances += renderer->stats.instances;
+    total->uploaded_bytes += renderer->stats.uploaded_bytes;
+    total->binds_elided += renderer->stats.binds_elided;
+    total->error_checks_elided += renderer->stats.error_checks_elided;
+    renderer->frames += 1;
+}
+
+RendererStats renderer_get_frame_stats(Renderer* renderer)
+{
+    return renderer->frame_stats;
+}
+
+void renderer_set_clip(Renderer* renderer, Vector2 position, Vector2 size)
+{
+    renderer_flush(renderer);
+
+    // The scissor box is in framebuffer pixels, counted from the bottom
+    GLint viewport[4];
+    gl(GetIntegerv, GL_VIEWPORT, viewport);
+
+    float scale_x = (float)viewport[2] / renderer->screen_width;
+    float scale_y = (float)viewport[3] / renderer->screen_height;
+
+    int x0 = floorf(position.x * scale_x);
+    int x1 = ceilf((position.x + size.x) * scale_x);
+    int y0 = floorf((renderer->screen_height - position.y - size.y) * scale_y);
+    int y1 = ceilf((renderer->screen_height - position.y) * scale_y);
+
+    gl(Enable, GL_SCISSOR_TEST);
+    gl(Scissor, viewport[0] + x0, viewport[1] + y0, x1 - x0, y1 - y0);
+}
+
+void renderer_reset_clip(Renderer* renderer)
+{
+    renderer_flush(renderer);
+    gl(Disable, GL_SCISSOR_TEST);
+}
+
+void renderer_set_blending(Renderer* renderer, bool enabled)
+{
+    renderer_flush(renderer);
+
+    if (enabled) {
+        gl(Enable, GL_BLEND);
+        gl(BlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        gl(Disable, GL_BLEND);
+    }
+}
+
+void renderer_set_crop(Renderer* renderer, Vector2 position, Vector2 size)
+{
+    renderer->crop_enabled = true;
+    renderer->crop_min = position;
+    renderer->crop_max = (Vector2) { position.x + size.x, position.y + size.y };
+}
+
+void renderer_reset_crop(Renderer* renderer)
+{
+    renderer->crop_enabled = false;
 }
 
 void renderer_draw_triangle(Renderer* renderer,
@@ -161,33 +501,9 @@ void renderer_draw_triangle(Renderer* renderer,
 {
     sort_triangle(&a, &b, &c);
 
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(a),
-                                                           0.0f,
-                                                           0.0f,
-                                                           V4X(color),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(b),
-                                                           1.0f,
-                                                           0.0f,
-                                                           V4X(color),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(c),
-                                                           1.0f,
-                                                           1.0f,
-                                                           V4X(color),
-                                                       });
-
-    index_buffer_push_index(renderer->index_buffer, 0);
-    index_buffer_push_index(renderer->index_buffer, 1);
-    index_buffer_push_index(renderer->index_buffer, 2);
-
-    gl(DrawElements, GL_TRIANGLES, index_buffer_count(renderer->index_buffer),
-       GL_UNSIGNED_INT, NULL);
-
-    renderer_clear_buffers(renderer);
+    // A quad whose second triangle has no area
+    renderer_push_quad(renderer, renderer->default_texture, a, b, c, c,
+                       (Vector2) { 0.0f, 0.0f }, (Vector2) { 1.0f, 1.0f }, color);
 }
 
 void renderer_draw_texture(Renderer* renderer, Texture* texture,
@@ -201,100 +517,33 @@ void renderer_draw_texture(Renderer* renderer, Texture* texture,
 void renderer_draw_texture_ex(Renderer* renderer, Texture* texture,
                               Vector2 position, Vector2 size, Vector4 tint)
 {
-    Vector2 a = { position.x, position.y + size.y };
-    Vector2 b = { position.x + size.x, position.y + size.y };
-    Vector2 c = { position.x + size.x, position.y };
-    Vector2 d = position;
-
-    renderer_bind_texture(renderer, texture);
-
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(a),
-                                                           0.0f,
-                                                           0.0f,
-                                                           V4X(tint),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(b),
-                                                           1.0f,
-                                                           0.0f,
-                                                           V4X(tint),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(c),
-                                                           1.0f,
-                                                           1.0f,
-                                                           V4X(tint),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(d),
-                                                           0.0f,
-                                                           1.0f,
-                                                           V4X(tint),
-                                                       });
-
-    // First triangle
-    index_buffer_push_index(renderer->index_buffer, 0);
-    index_buffer_push_index(renderer->index_buffer, 1);
-    index_buffer_push_index(renderer->index_buffer, 2);
-
-    // Second triangle
-    index_buffer_push_index(renderer->index_buffer, 2);
-    index_buffer_push_index(renderer->index_buffer, 3);
-    index_buffer_push_index(renderer->index_buffer, 0);
-
-    gl(DrawElements, GL_TRIANGLES, index_buffer_count(renderer->index_buffer),
-       GL_UNSIGNED_INT, NULL);
-
-    renderer_bind_texture(renderer, renderer->default_texture);
-    renderer_clear_buffers(renderer);
+    // The texture's first row is at the bottom of the rectangle
+    renderer_push_rectangle(renderer, texture, position, size,
+                            (Vector2) { 0.0f, 1.0f }, (Vector2) { 1.0f, 0.0f },
+                            tint);
 }
 
 void renderer_draw_rectangle(Renderer* renderer,
                              Vector2 position, Vector2 size, Vector4 color)
 {
-    Vector2 a = { position.x, position.y + size.y };
-    Vector2 b = { position.x + size.x, position.y + size.y };
-    Vector2 c = { position.x + size.x, position.y };
-    Vector2 d = position;
-
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(a),
-                                                           0.0f,
-                                                           0.0f,
-                                                           V4X(color),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(b),
-                                                           1.0f,
-                                                           0.0f,
-                                                           V4X(color),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(c),
-                                                           1.0f,
-                                                           1.0f,
-                                                           V4X(color),
-                                                       });
-    vertex_buffer_push_vertex(renderer->vertex_buffer, (Vertex) {
-                                                           V2X(d),
-                                                           0.0f,
-                                                           1.0f,
-                                                           V4X(color),
-                                                       });
-
-    // First triangle
-    index_buffer_push_index(renderer->index_buffer, 0);
-    index_buffer_push_index(renderer->index_buffer, 1);
-    index_buffer_push_index(renderer->index_buffer, 2);
-
-    // Second triangle
-    index_buffer_push_index(renderer->index_buffer, 2);
-    index_buffer_push_index(renderer->index_buffer, 3);
-    index_buffer_push_index(renderer->index_buffer, 0);
-
-    gl(DrawElements, GL_TRIANGLES, index_buffer_count(renderer->index_buffer),
-       GL_UNSIGNED_INT, NULL);
+    renderer_push_rectangle(renderer, renderer->default_texture, position, size,
+                            (Vector2) { 0.0f, 1.0f }, (Vector2) { 1.0f, 0.0f },
+                            color);
+}
 
-    renderer_clear_buffers(renderer);
+void renderer_draw_text(Renderer* renderer, Text* text,
+                        Vector2 position, Vector4 color)
+{
+    for (size_t i = 0; i < text->glyphs_count; ++i) {
+        TextGlyph* glyph = &text->glyphs[i];
+
+        renderer_push_rectangle(renderer, text->texture,
+                                (Vector2) {
+                                    position.x + glyph->position.x,
+                                    position.y + glyph->position.y,
+                                },
+                                glyph->size,
+                                glyph->uv_top_left, glyph->uv_bottom_right,
+                                color);
+    }
 }
@@ -1,23 +1,70 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "opengl/index_buffer.h"
+#include "opengl/instance_buffer.h"
 #include "opengl/shader.h"
 #include "opengl/texture.h"
 #include "opengl/vertex_array.h"
 #include "opengl/vertex_buffer.h"
+#include "text.h"
 
 #include "types.h"
 
+typedef struct {
+    size_t draw_calls;
+    size_t vertices;
+    size_t instances;
+    size_t uploaded_bytes;
+
+    // Binds skipped because the same thing was bound, and GL calls made
+    // without checking for errors, see `gl_errors.h`
+    size_t binds_elided;
+    size_t error_checks_elided;
+} RendererStats;
+
 typedef struct {
     int screen_width;
     int screen_height;
 
     Shader* default_shader;
+    int mvp_uniform;
+    // Screen size the MVP matrix was last computed for
+    int mvp_width;
+    int mvp_height;
     Texture* default_texture;
 
     VertexArray* vertex_array;
     VertexBuffer* vertex_buffer;
     IndexBuffer* index_buffer;
+
+    // Quads are drawn as instances of a single quad when it's not NULL,
+    // as 4 vertices each otherwise
+    InstanceBuffer* instance_buffer;
+
+    // What the vertices waiting in `vertex_buffer` are drawn with. They
+    // are only drawn once a different texture is needed, or when drawing
+    // ends
+    Texture* batch_texture;
+
+    // Rectangles and textures are cut down to this area, see
+    // `renderer_set_crop`
+    bool crop_enabled;
+    Vector2 crop_min;
+    Vector2 crop_max;
+
+    // Counted since drawing began, and for the last frame
+    RendererStats stats;
+    RendererStats frame_stats;
+
+    // Added up over every frame, logged when the renderer is destroyed
+    RendererStats total_stats;
+    size_t frames;
+
+    // Thread-wide counts when drawing began
+    size_t binds_elided_at_begin;
+    size_t error_checks_elided_at_begin;
 } Renderer;
 
 // Returns NULL on error. DOES NOT SET THE VIEWPORT!!!
@@ -27,6 +74,27 @@ void renderer_destroy(Renderer* renderer);
 Vector2 renderer_get_screen_size(Renderer* renderer);
 
 void renderer_begin_drawing(Renderer* renderer);
+// Draws whatever is still batched. Call it before anything that reads
+// what was drawn so far, like swapping buffers
+void renderer_end_drawing(Renderer* renderer);
+
+// Statistics of the last frame, between begin and end drawing
+RendererStats renderer_get_frame_stats(Renderer* renderer);
+
+// Only draws inside the given rectangle, clears included, until the clip
+// is reset
+void renderer_set_clip(Renderer* renderer, Vector2 position, Vector2 size);
+void renderer_reset_clip(Renderer* renderer);
+
+// Blends what's drawn with what's below, according to its alpha. Nothing
+// is blended by default
+void renderer_set_blending(Renderer* renderer, bool enabled);
+
+// Cuts rectangles, textures and text down to the given rectangle, until
+// the crop is reset. Unlike the clip it's done on the vertices, so nothing
+// has to be flushed. Triangles are drawn whole
+void renderer_set_crop(Renderer* renderer, Vector2 position, Vector2 size);
+void renderer_reset_crop(Renderer* renderer);
 
 void renderer_draw_triangle(Renderer* renderer,
                             Vector2 a, Vector2 b, Vector2 c,
@@ -37,3 +105,6 @@ void renderer_draw_texture_ex(Renderer* renderer, Texture* texture,
                               Vector2 position, Vector2 size, Vector4 tint);
 void renderer_draw_rectangle(Renderer* renderer,
                              Vector2 position, Vector2 size, Vector4 color);
+// Draws the glyphs with `color`, which should be blended
+void renderer_draw_text(Renderer* renderer, Text* text,
+                        Vector2 position, Vector4 color);
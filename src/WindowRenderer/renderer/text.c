@@ -0,0 +1,88 @@
+#include "text.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Returns the codepoint at `*string` and moves past it. Invalid bytes are
+// returned as they are
+static uint32_t decode_utf8(const char** string)
+{
+    const unsigned char* bytes = (const unsigned char*)*string;
+
+    int length = 1;
+    uint32_t codepoint = bytes[0];
+    if ((bytes[0] & 0xE0) == 0xC0) {
+        length = 2;
+        codepoint = bytes[0] & 0x1F;
+    } else if ((bytes[0] & 0xF0) == 0xE0) {
+        length = 3;
+        codepoint = bytes[0] & 0x0F;
+    } else if ((bytes[0] & 0xF8) == 0xF0) {
+        length = 4;
+        codepoint = bytes[0] & 0x07;
+    }
+
+    for (int i = 1; i < length; ++i) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            *string += 1;
+            return bytes[0];
+        }
+        codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+    }
+
+    *string += length;
+    return codepoint;
+}
+
+Text* text_create(GlyphAtlas* atlas, const char* string, int pixel_size, float max_width)
+{
+    Text* text = malloc(sizeof(*text));
+    memset(text, 0, sizeof(*text));
+
+    text->texture = atlas->texture;
+
+    float ascent;
+    float descent;
+    glyph_atlas_get_line_metrics(atlas, pixel_size, &ascent, &descent);
+
+    size_t glyphs_capacity = strlen(string);
+    text->glyphs = malloc(glyphs_capacity * sizeof(*text->glyphs));
+
+    float pen_x = 0.0f;
+    while (*string) {
+        uint32_t codepoint = decode_utf8(&string);
+
+        Glyph glyph;
+        if (!glyph_atlas_get(atlas, codepoint, pixel_size, &glyph))
+            continue;
+
+        if (pen_x + glyph.offset.x + glyph.size.x > max_width)
+            break;
+
+        if (glyph.size.x > 0 && glyph.size.y > 0) {
+            text->glyphs[text->glyphs_count++] = (TextGlyph) {
+                // Whole pixels, so glyphs aren't blurred by filtering
+                .position = {
+                    roundf(pen_x) + glyph.offset.x,
+                    roundf(ascent) + glyph.offset.y,
+                },
+                .size = glyph.size,
+                .uv_top_left = glyph.uv_top_left,
+                .uv_bottom_right = glyph.uv_bottom_right,
+            };
+        }
+
+        pen_x += glyph.advance;
+    }
+
+    text->size = (Vector2) { pen_x < max_width ? pen_x : max_width, ascent + descent };
+
+    return text;
+}
+
+void text_destroy(Text* text)
+{
+    free(text->glyphs);
+    free(text);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "glyph_atlas.h"
+#include "opengl/texture.h"
+#include "types.h"
+
+typedef struct {
+    // Relative to the top left of the text
+    Vector2 position;
+    Vector2 size;
+
+    Vector2 uv_top_left;
+    Vector2 uv_bottom_right;
+} TextGlyph;
+
+/*
+ * A line of text laid out once, so drawing it only copies its glyphs.
+ * Only valid as long as the atlas it was laid out with.
+ */
+typedef struct {
+    // The atlas texture
+    Texture* texture;
+
+    TextGlyph* glyphs;
+    size_t glyphs_count;
+
+    Vector2 size;
+} Text;
+
+// Lays `string` out, UTF-8, leaving out glyphs that would go past
+// `max_width`
+Text* text_create(GlyphAtlas* atlas, const char* string, int pixel_size, float max_width);
+void text_destroy(Text* text);
@@ -0,0 +1,196 @@
+#include "client.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log.h"
+
+Client* client_create(int fd)
+{
+    Client* client = malloc(sizeof(*client));
+    memset(client, 0, sizeof(*client));
+
+    client->fd = fd;
+    client->event_ring_wakeup_fd = -1;
+    client->event_ring_space_fd = -1;
+
+    return client;
+}
+
+void client_destroy(Client* client)
+{
+    for (size_t i = client->fds_head; i < client->fds_count; ++i) {
+        close(client->fds[i]);
+    }
+    free(client->fds);
+
+    free(client->receive_buffer);
+    free(client->outbox);
+
+    if (client->event_ring) {
+        munmap(client->event_ring, client->event_ring_size);
+        close(client->event_ring_wakeup_fd);
+        close(client->event_ring_space_fd);
+    }
+
+    close(client->fd);
+    free(client);
+}
+
+unsigned char* client_reserve_receive_buffer(Client* client, size_t size)
+{
+    size_t needed = client->receive_size + size;
+
+    if (needed > client->receive_capacity) {
+        size_t new_capacity = client->receive_capacity == 0 ? 4096 : client->receive_capacity;
+        while (new_capacity < needed)
+            new_capacity *= 2;
+
+        client->receive_buffer = realloc(client->receive_buffer, new_capacity);
+        client->receive_capacity = new_capacity;
+    }
+
+    return client->receive_buffer + client->receive_size;
+}
+
+void client_consume_receive_buffer(Client* client, size_t size)
+{
+    memmove(client->receive_buffer, client->receive_buffer + size,
+            client->receive_size - size);
+    client->receive_size -= size;
+}
+
+void client_append_outbox(Client* client, unsigned char const* data, size_t size)
+{
+    size_t needed = client->outbox_size + size;
+
+    if (needed > client->outbox_capacity) {
+        size_t new_capacity = client->outbox_capacity == 0 ? 4096 : client->outbox_capacity;
+        while (new_capacity < needed)
+            new_capacity *= 2;
+
+        client->outbox = realloc(client->outbox, new_capacity);
+        client->outbox_capacity = new_capacity;
+    }
+
+    memcpy(client->outbox + client->outbox_size, data, size);
+    client->outbox_size += size;
+}
+
+bool client_send_outbox(Client* client)
+{
+    size_t sent = 0;
+
+    while (sent < client->outbox_size) {
+        ssize_t sent_now = send(client->fd, client->outbox + sent, client->outbox_size - sent,
+                                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent_now == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            log_log(LOG_ERROR, "Could not send data to the client: %s", strerror(errno));
+            return false;
+        }
+        sent += sent_now;
+    }
+
+    memmove(client->outbox, client->outbox + sent, client->outbox_size - sent);
+    client->outbox_size -= sent;
+
+    return true;
+}
+
+void client_push_fd(Client* client, int fd)
+{
+    // Reuse the space of consumed file descriptors before growing
+    if (client->fds_count == client->fds_capacity && client->fds_head != 0) {
+        memmove(client->fds, client->fds + client->fds_head,
+                (client->fds_count - client->fds_head) * sizeof(*client->fds));
+        client->fds_count -= client->fds_head;
+        client->fds_head = 0;
+    }
+
+    if (client->fds_count == client->fds_capacity) {
+        client->fds_capacity = client->fds_capacity == 0 ? 8 : client->fds_capacity * 2;
+        client->fds = realloc(client->fds, client->fds_capacity * sizeof(*client->fds));
+    }
+
+    client->fds[client->fds_count++] = fd;
+}
+
+int client_pop_fd(Client* client)
+{
+    if (client->fds_head == client->fds_count)
+        return -1;
+
+    int fd = client->fds[client->fds_head++];
+
+    if (client->fds_head == client->fds_count) {
+        client->fds_head = 0;
+        client->fds_count = 0;
+    }
+
+    return fd;
+}
+
+void client_set_event_ring(Client* client, WindowRendererEventRing* event_ring,
+                           size_t size, uint32_t capacity, int wakeup_fd, int space_fd)
+{
+    client->event_ring = event_ring;
+    client->event_ring_size = size;
+    client->event_ring_capacity = capacity;
+    client->event_ring_tail = atomic_load_explicit(&event_ring->tail, memory_order_relaxed);
+    client->event_ring_wakeup_fd = wakeup_fd;
+    client->event_ring_space_fd = space_fd;
+}
+
+static bool event_ring_is_full(Client* client)
+{
+    uint32_t head = atomic_load_explicit(&client->event_ring->head, memory_order_acquire);
+
+    // A bogus `head` makes the ring look full, which only hurts the client
+    return (uint32_t)(client->event_ring_tail - head) >= client->event_ring_capacity;
+}
+
+bool client_push_ring_event(Client* client, WindowRendererEvent event)
+{
+    WindowRendererEventRing* ring = client->event_ring;
+
+    if (event_ring_is_full(client)) {
+        atomic_store_explicit(&ring->server_waiting, 1, memory_order_relaxed);
+
+        // Either the client sees the flag after reading, or we see the
+        // room it made
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (event_ring_is_full(client))
+            return false;
+    }
+
+    uint32_t tail = client->event_ring_tail++;
+    ring->events[tail & (client->event_ring_capacity - 1)] = event;
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+void client_wake_event_ring(Client* client)
+{
+    // Pairs with the fence the client goes through before sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&client->event_ring->client_sleeping, memory_order_relaxed))
+        return;
+
+    uint64_t value = 1;
+    if (write(client->event_ring_wakeup_fd, &value, sizeof(value)) == -1) {
+        log_log(LOG_WARNING, "Could not wake up client: %s", strerror(errno));
+    }
+}
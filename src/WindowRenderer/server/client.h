@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WindowRenderer/windowrenderer.h"
+
+typedef struct {
+    int fd;
+
+    // Position in `Server.clients`. Used for O(1) removal
+    size_t index;
+
+    // Set once the client was removed from the server. Its destruction
+    // is deferred until the epoll events that may still refer to it are
+    // handled
+    bool closed;
+
+    // Set when the socket (or the event ring) was too full to take more
+    // events. Delivery resumes once the client makes room
+    bool events_blocked;
+
+    // Shared with the client through WRCMD_SET_EVENT_RING. NULL when
+    // events are sent on the socket
+    WindowRendererEventRing* event_ring;
+    size_t event_ring_size;
+    uint32_t event_ring_capacity;
+    // Our own copy, the one in the ring can be written by the client
+    uint32_t event_ring_tail;
+    int event_ring_wakeup_fd;
+    int event_ring_space_fd;
+
+    // Events the client's socket is watched for in the server's epoll
+    // instance
+    uint32_t epoll_events;
+
+    // Responses the socket was too full to take, sent before anything
+    // else. No commands are read while there are some
+    unsigned char* outbox;
+    size_t outbox_size;
+    size_t outbox_capacity;
+
+    // Bytes received but not yet parsed into whole commands
+    unsigned char* receive_buffer;
+    size_t receive_size;
+    size_t receive_capacity;
+
+    // File descriptors received but not yet consumed by a command,
+    // in the order they were received. The next one to consume is at
+    // `fds_head`
+    int* fds;
+    size_t fds_head;
+    size_t fds_count;
+    size_t fds_capacity;
+} Client;
+
+Client* client_create(int fd);
+void client_destroy(Client* client);
+
+// Makes sure there is room for at least `size` more bytes in the
+// receive buffer. Returns a pointer to the free space.
+unsigned char* client_reserve_receive_buffer(Client* client, size_t size);
+void client_consume_receive_buffer(Client* client, size_t size);
+
+void client_append_outbox(Client* client, unsigned char const* data, size_t size);
+// Sends as much of the outbox as the socket takes. Returns false if the
+// connection is broken
+bool client_send_outbox(Client* client);
+
+void client_set_event_ring(Client* client, WindowRendererEventRing* event_ring,
+                           size_t size, uint32_t capacity, int wakeup_fd, int space_fd);
+// Returns false if the ring is full. The client is then asked to write
+// to `event_ring_space_fd` once it reads events
+bool client_push_ring_event(Client* client, WindowRendererEvent event);
+// Wakes the client up if it is waiting for events
+void client_wake_event_ring(Client* client);
+
+void client_push_fd(Client* client, int fd);
+// Returns -1 if there are no file descriptors left
+int client_pop_fd(Client* client);
@@ -1,17 +1,92 @@
 #include "event_list.h"
 
-void event_list_push(EventList* event_list, WindowRendererEvent event)
+_Static_assert((EVENT_LIST_MAX & (EVENT_LIST_MAX - 1)) == 0,
+               "EVENT_LIST_MAX must be a power of two");
+
+bool event_list_push(EventList* event_list, WindowRendererEvent event, size_t limit)
 {
-    event_list->events[event_list->events_count % EVENT_LIST_MAX] = event;
-    event_list->events_count++;
+    size_t tail = atomic_load_explicit(&event_list->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&event_list->head, memory_order_acquire);
+
+    if (limit > EVENT_LIST_MAX)
+        limit = EVENT_LIST_MAX;
+    if (tail - head >= limit)
+        return false;
+
+    EventSlot* slot = &event_list->slots[tail % EVENT_LIST_MAX];
+    slot->event = event;
+
+    // Publishes the event to the consumer
+    atomic_store_explicit(&slot->sequence, tail + 1, memory_order_release);
+    atomic_store_explicit(&event_list->tail, tail + 1, memory_order_release);
+    return true;
 }
 
-WindowRendererEvent event_list_pop(EventList* event_list)
+bool event_list_replace_newest(EventList* event_list, WindowRendererEvent event)
 {
-    return event_list->events[--event_list->events_count];
+    size_t tail = atomic_load_explicit(&event_list->tail, memory_order_relaxed);
+    if (tail == 0)
+        return false;
+
+    EventSlot* slot = &event_list->slots[(tail - 1) % EVENT_LIST_MAX];
+
+    // Fails if the consumer already claimed or popped the event
+    size_t queued = tail;
+    if (!atomic_compare_exchange_strong_explicit(&slot->sequence, &queued,
+                                                 queued | EVENT_SLOT_BUSY,
+                                                 memory_order_acquire,
+                                                 memory_order_relaxed))
+        return false;
+
+    bool replaced = slot->event.kind == event.kind;
+    if (replaced)
+        slot->event = event;
+
+    atomic_store_explicit(&slot->sequence, queued, memory_order_release);
+    return replaced;
 }
 
-size_t event_list_get_count(EventList *event_list)
+bool event_list_claim(EventList* event_list, WindowRendererEvent* event)
 {
-    return event_list->events_count;
+    size_t head = atomic_load_explicit(&event_list->head, memory_order_relaxed);
+    EventSlot* slot = &event_list->slots[head % EVENT_LIST_MAX];
+
+    // Fails if the list is empty or the producer is replacing the event.
+    // In the latter case the producer reports the window again afterwards
+    size_t queued = head + 1;
+    if (!atomic_compare_exchange_strong_explicit(&slot->sequence, &queued,
+                                                 queued | EVENT_SLOT_BUSY,
+                                                 memory_order_acquire,
+                                                 memory_order_relaxed))
+        return false;
+
+    *event = slot->event;
+    return true;
+}
+
+void event_list_pop(EventList* event_list)
+{
+    size_t head = atomic_load_explicit(&event_list->head, memory_order_relaxed);
+    EventSlot* slot = &event_list->slots[head % EVENT_LIST_MAX];
+
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+
+    // Hands the slot back to the producer
+    atomic_store_explicit(&event_list->head, head + 1, memory_order_release);
+}
+
+void event_list_release(EventList* event_list)
+{
+    size_t head = atomic_load_explicit(&event_list->head, memory_order_relaxed);
+    EventSlot* slot = &event_list->slots[head % EVENT_LIST_MAX];
+
+    atomic_store_explicit(&slot->sequence, head + 1, memory_order_release);
+}
+
+size_t event_list_get_count(EventList* event_list)
+{
+    size_t head = atomic_load_explicit(&event_list->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&event_list->tail, memory_order_acquire);
+
+    return tail - head;
 }
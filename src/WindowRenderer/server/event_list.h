@@ -1,17 +1,59 @@
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "WindowRenderer/windowrenderer.h"
 
+// Must be a power of two
 #define EVENT_LIST_MAX 1024
 
+#define EVENT_SLOT_BUSY ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+typedef struct {
+    /*
+     * For the event at index `i` (before wrapping):
+     *   0                          -> not queued (yet, or anymore)
+     *   i + 1                      -> queued
+     *   (i + 1) | EVENT_SLOT_BUSY  -> being read by the consumer, or being
+     *                                 replaced by the producer
+     */
+    atomic_size_t sequence;
+    WindowRendererEvent event;
+} EventSlot;
+
+/*
+ * Fixed-size FIFO of events, safe to use without locking as long as only
+ * one thread pushes (the window manager) and only one thread claims and
+ * pops (the dispatcher).
+ *
+ * `head` and `tail` only ever grow; slots are indexed modulo
+ * EVENT_LIST_MAX, so `tail - head` is the number of queued events.
+ */
 typedef struct {
-    WindowRendererEvent events[EVENT_LIST_MAX];
-    size_t events_count;
+    EventSlot slots[EVENT_LIST_MAX];
+
+    // Next event to pop. Only written by the consumer
+    atomic_size_t head;
+    // Next free slot. Only written by the producer
+    atomic_size_t tail;
 } EventList;
 
-void event_list_push(EventList* event_list, WindowRendererEvent event);
-WindowRendererEvent event_list_pop(EventList* event_list);
+// Producer side. Returns false if more than `limit` events are queued
+bool event_list_push(EventList* event_list, WindowRendererEvent event, size_t limit);
+// Producer side. Overwrites the newest event with `event` if it is of the
+// same kind and the consumer hasn't started reading it. Returns false if
+// nothing was replaced
+bool event_list_replace_newest(EventList* event_list, WindowRendererEvent event);
+
+// Consumer side. Copies the oldest event into `event` and keeps the
+// producer from replacing it. Returns false if there is nothing to claim.
+// Has to be followed by either `event_list_pop` or `event_list_release`
+bool event_list_claim(EventList* event_list, WindowRendererEvent* event);
+// Removes the claimed event
+void event_list_pop(EventList* event_list);
+// Leaves the claimed event queued, to be claimed again later
+void event_list_release(EventList* event_list);
 
 size_t event_list_get_count(EventList* event_list);
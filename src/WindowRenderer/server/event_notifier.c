@@ -0,0 +1,71 @@
+#include "event_notifier.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+
+void event_notifier_init(EventNotifier* notifier, int wakeup_fd)
+{
+    memset(notifier, 0, sizeof(*notifier));
+    pthread_mutex_init(&notifier->mutex, NULL);
+    notifier->wakeup_fd = wakeup_fd;
+}
+
+void event_notifier_destroy(EventNotifier* notifier)
+{
+    pthread_mutex_destroy(&notifier->mutex);
+    free(notifier->window_ids);
+}
+
+void event_notifier_notify(EventNotifier* notifier, int window_id)
+{
+    pthread_mutex_lock(&notifier->mutex);
+
+    if (notifier->window_ids_count == notifier->window_ids_capacity) {
+        notifier->window_ids_capacity = notifier->window_ids_capacity == 0
+            ? 16
+            : notifier->window_ids_capacity * 2;
+        notifier->window_ids = realloc(notifier->window_ids,
+                                       notifier->window_ids_capacity * sizeof(*notifier->window_ids));
+    }
+
+    bool first = notifier->window_ids_count == 0;
+    notifier->window_ids[notifier->window_ids_count++] = window_id;
+
+    pthread_mutex_unlock(&notifier->mutex);
+
+    // Later notifications are picked up by the same wakeup
+    if (first) {
+        uint64_t value = 1;
+        if (write(notifier->wakeup_fd, &value, sizeof(value)) == -1) {
+            log_log(LOG_WARNING, "Could not wake up event delivery: %s",
+                    strerror(errno));
+        }
+    }
+}
+
+size_t event_notifier_take(EventNotifier* notifier,
+                           int** window_ids, size_t* window_ids_capacity)
+{
+    pthread_mutex_lock(&notifier->mutex);
+
+    size_t count = notifier->window_ids_count;
+
+    if (count > *window_ids_capacity) {
+        *window_ids_capacity = count;
+        *window_ids = realloc(*window_ids, count * sizeof(**window_ids));
+    }
+    if (count != 0)
+        memcpy(*window_ids, notifier->window_ids, count * sizeof(**window_ids));
+
+    notifier->window_ids_count = 0;
+
+    pthread_mutex_unlock(&notifier->mutex);
+
+    return count;
+}
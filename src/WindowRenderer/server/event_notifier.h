@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * Tells the event delivery thread which windows have events waiting.
+ *
+ * A window is only reported when its event list goes from empty to
+ * non-empty, and the delivery thread is only woken up when the first
+ * window gets reported. While nothing happens, nobody gets woken up.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+
+    int* window_ids;
+    size_t window_ids_count;
+    size_t window_ids_capacity;
+
+    // Becomes readable when there are windows to deliver events for
+    int wakeup_fd;
+} EventNotifier;
+
+void event_notifier_init(EventNotifier* notifier, int wakeup_fd);
+void event_notifier_destroy(EventNotifier* notifier);
+
+void event_notifier_notify(EventNotifier* notifier, int window_id);
+
+// Moves the reported window IDs into `*window_ids`, growing it if needed.
+// Returns how many IDs were moved.
+size_t event_notifier_take(EventNotifier* notifier,
+                           int** window_ids, size_t* window_ids_capacity);
@@ -1,21 +1,31 @@
+#define _GNU_SOURCE
+
 #include "server.h"
 
 #include "WindowRenderer/windowrenderer.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "../trace.h"
 #include "log.h"
 #include "session.h"
 #include "window.h"
+#include "wire.h"
 
 #define LISTEN_QUEUE 20
 
@@ -30,72 +40,213 @@ Server* server_create(void)
     Server* server = malloc(sizeof(*server));
     memset(server, 0, sizeof(*server));
 
+    server->socket = -1;
+    server->epoll_fd = -1;
+    server->wakeup_fd = -1;
+    server->windows_changed_fd = -1;
     server->socket_path = session_generate_socket_name();
 
+    event_notifier_init(&server->event_notifier, -1);
     pthread_mutex_init(&server->windows_mutex, NULL);
+    window_table_init(&server->window_table);
 
     return server;
 }
 
+static void server_wakeup(Server* server)
+{
+    uint64_t value = 1;
+    if (write(server->wakeup_fd, &value, sizeof(value)) == -1)
+        log_log(LOG_WARNING, "Could not wake up dispatcher thread: %s",
+                strerror(errno));
+}
+
 void server_destroy(Server* server)
 {
-    close(server->socket);
+    if (atomic_load(&server->dispatcher_thread_running)) {
+        atomic_store(&server->dispatcher_thread_running, false);
+        server_wakeup(server);
+        pthread_join(server->dispatcher_thread, NULL);
+    }
+
+    for (size_t i = 0; i < server->clients_count; ++i) {
+        client_destroy(server->clients[i]);
+    }
+    free(server->clients);
+
+    for (size_t i = 0; i < server->closed_clients_count; ++i) {
+        client_destroy(server->closed_clients[i]);
+    }
+    free(server->closed_clients);
+
+    if (server->epoll_fd != -1)
+        close(server->epoll_fd);
+    if (server->wakeup_fd != -1)
+        close(server->wakeup_fd);
+    if (server->windows_changed_fd != -1)
+        close(server->windows_changed_fd);
+    if (server->socket != -1)
+        close(server->socket);
+
+    LockStats stats = server->windows_lock_stats;
+    if (stats.count != 0) {
+        log_log(LOG_INFO, "Window lock taken %zu times, waited %.1f us on average (%.1f us max), "
+                          "held %.1f us on average (%.1f us max)",
+                stats.count,
+                stats.wait_total / 1000.0 / stats.count, stats.wait_max / 1000.0,
+                stats.hold_total / 1000.0 / stats.count, stats.hold_max / 1000.0);
+    }
 
+    if (server->windows_snapshot)
+        window_stack_unref(server->windows_snapshot);
     for (size_t i = 0; i < server->windows_count; ++i) {
-        window_destroy(server->windows[i]);
+        window_unref(server->windows[i]);
     }
+    free(server->windows);
+    window_table_destroy(&server->window_table);
 
     pthread_mutex_destroy(&server->windows_mutex);
+    event_notifier_destroy(&server->event_notifier);
 
     free(server);
 }
 
-static int server_find_window(Server* server, int id)
+static uint64_t get_time_ns(void)
 {
-    for (size_t i = 0; i < server->windows_count; ++i) {
-        if (server->windows[i]->id == id) {
-            return i;
-        }
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static void server_lock_windows(Server* server)
+{
+    uint64_t start = get_time_ns();
+    pthread_mutex_lock(&server->windows_mutex);
+    uint64_t locked_at = get_time_ns();
+
+    LockStats* stats = &server->windows_lock_stats;
+    uint64_t wait = locked_at - start;
+
+    stats->count += 1;
+    stats->wait_total += wait;
+    if (wait > stats->wait_max)
+        stats->wait_max = wait;
+
+    server->windows_locked_at = locked_at;
+}
+
+static void server_unlock_windows(Server* server)
+{
+    LockStats* stats = &server->windows_lock_stats;
+    uint64_t hold = get_time_ns() - server->windows_locked_at;
+
+    stats->hold_total += hold;
+    if (hold > stats->hold_max)
+        stats->hold_max = hold;
+
+    pthread_mutex_unlock(&server->windows_mutex);
+}
+
+// Only writes the eventfd when the flag was clear, so the main thread is
+// woken up once per `server_take_windows_changed`
+static void server_mark_windows_changed(Server* server)
+{
+    if (atomic_exchange(&server->windows_changed, true))
+        return;
+
+    uint64_t value = 1;
+    if (write(server->windows_changed_fd, &value, sizeof(value)) == -1)
+        log_log(LOG_WARNING, "Could not signal window changes: %s", strerror(errno));
+}
+
+// Called whenever the window stack changes
+static void server_invalidate_windows_snapshot(Server* server)
+{
+    if (server->windows_snapshot) {
+        window_stack_unref(server->windows_snapshot);
+        server->windows_snapshot = NULL;
     }
-    return -1;
+
+    server_mark_windows_changed(server);
 }
 
-/*
- * WARNING: this function takes an index in the server->windows array
- *          instead of a window id!
- */
-static void server_remove_window(Server* server, int window_index)
+static void server_push_window(Server* server, Window* window)
 {
-    if ((size_t)window_index < server->windows_count - 1) {
-        memmove(&server->windows[window_index],
-                &server->windows[window_index + 1],
-                (server->windows_count - window_index - 1) * sizeof(void*));
+    if (server->windows_count == server->windows_capacity) {
+        server->windows_capacity = server->windows_capacity == 0
+            ? 16
+            : server->windows_capacity * 2;
+        server->windows = realloc(server->windows,
+                                  server->windows_capacity * sizeof(*server->windows));
     }
+
+    window->stack_index = server->windows_count;
+    server->windows[server->windows_count++] = window;
+
+    server_invalidate_windows_snapshot(server);
+}
+
+// Takes the window out of the window stack, but not out of the window table
+static void server_unstack_window(Server* server, Window* window)
+{
+    size_t index = window->stack_index;
+
+    memmove(&server->windows[index],
+            &server->windows[index + 1],
+            (server->windows_count - index - 1) * sizeof(*server->windows));
     server->windows_count -= 1;
+
+    for (size_t i = index; i < server->windows_count; ++i) {
+        server->windows[i]->stack_index = i;
+    }
+
+    server_invalidate_windows_snapshot(server);
+}
+
+static void server_remove_window(Server* server, Window* window)
+{
+    server_unstack_window(server, window);
+    window_table_remove(&server->window_table, window->id);
 }
 
-static WindowRendererResponse server_create_window(Server* server,
+// Returns NULL unless the window exists and belongs to `client`
+static Window* server_find_client_window(Server* server, Client* client, int id)
+{
+    Window* window = window_table_get(&server->window_table, id);
+    if (!window || window->client != client)
+        return NULL;
+    return window;
+}
+
+static WindowRendererResponse server_create_window(Server* server, Client* client,
                                                    char const* title, int width, int height)
 {
     server_lock_windows(server);
 
-    Window* window = window_create(title, width, height);
-    server->windows[server->windows_count++] = window;
-
     WindowRendererResponse response = {
         .kind = WRRESP_WINID,
         .status = WRSTATUS_OK,
-        .response = {
-            .window_id = window->id,
-        },
     };
 
-    server_unlock_windows(server);
+    Window* window = window_create(client, &server->event_notifier, title, width, height);
+
+    window->id = window_table_add(&server->window_table, window);
+    if (window->id == -1) {
+        window_unref(window);
+        response.status = WRSTATUS_TOO_MANY_WINDOWS;
+        goto defer;
+    }
 
+    server_push_window(server, window);
+    response.response.window_id = window->id;
+
+defer:
+    server_unlock_windows(server);
     return response;
 }
 
-static WindowRendererResponse server_close_window(Server* server, int window_id)
+static WindowRendererResponse server_close_window(Server* server, Client* client,
+                                                  int window_id)
 {
     server_lock_windows(server);
 
@@ -104,23 +255,26 @@ static WindowRendererResponse server_close_window(Server* server, int window_id)
         .status = WRSTATUS_OK,
     };
 
-    int index = server_find_window(server, window_id);
-    if (index == -1) {
+    Window* window = server_find_client_window(server, client, window_id);
+    if (!window) {
         response.status = WRSTATUS_INVALID_WINID;
         goto defer;
     }
 
-    window_destroy(server->windows[index]);
-    server_remove_window(server, index);
+    server_remove_window(server, window);
+    window_unref(window);
 
 defer:
     server_unlock_windows(server);
     return response;
 }
 
-static WindowRendererResponse server_set_window_dma_buf(Server* server, int window_id,
+static WindowRendererResponse server_set_window_dma_buf(Server* server, Client* client,
+                                                        int window_id,
                                                         WindowRendererDmaBuf dma_buf, int dma_buf_fd)
 {
+    uint64_t trace_begin = trace_now();
+
     server_lock_windows(server);
 
     WindowRendererResponse response = {
@@ -128,8 +282,8 @@ static WindowRendererResponse server_set_window_dma_buf(Server* server, int wind
         .status = WRSTATUS_OK,
     };
 
-    int index = server_find_window(server, window_id);
-    if (index == -1) {
+    Window* window = server_find_client_window(server, client, window_id);
+    if (!window) {
         response.status = WRSTATUS_INVALID_WINID;
         goto defer;
     }
@@ -139,195 +293,1015 @@ static WindowRendererResponse server_set_window_dma_buf(Server* server, int wind
         goto defer;
     }
 
-    if (dma_buf.width != server->windows[index]->width
-        || dma_buf.height != server->windows[index]->height) {
+    if (dma_buf.width != window->width
+        || dma_buf.height != window->height) {
         response.status = WRSTATUS_INVALID_DMA_BUF_SIZE;
         goto defer;
     }
 
-    server->windows[index]->dma_buf = (WindowDmaBuf) {
+    window_set_dma_buf(window, (WindowDmaBuf) {
         .present = true,
         .fd = dma_buf_fd,
         .width = dma_buf.width,
         .height = dma_buf.height,
         .format = dma_buf.format,
         .stride = dma_buf.stride,
+    });
+    server_mark_windows_changed(server);
+
+defer:
+    server_unlock_windows(server);
+
+    if (response.status == WRSTATUS_OK)
+        trace_record(TRACE_COMMIT, trace_begin, trace_now(), window_id);
+    return response;
+}
+
+static WindowRendererResponse server_set_window_buffer(Server* server, Client* client,
+                                                        WindowRendererSetWindowBuffer set_buffer,
+                                                        int dma_buf_fd)
+{
+    server_lock_windows(server);
+
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_OK,
     };
 
+    Window* window = server_find_client_window(server, client, set_buffer.window_id);
+    if (!window) {
+        response.status = WRSTATUS_INVALID_WINID;
+        goto defer;
+    }
+
+    if (set_buffer.buffer >= WR_WINDOW_BUFFERS_MAX) {
+        response.status = WRSTATUS_INVALID_BUFFER;
+        goto defer;
+    }
+
+    if (dma_buf_fd == -1) {
+        response.status = WRSTATUS_INVALID_DMA_BUF_FD;
+        goto defer;
+    }
+
+    WindowRendererDmaBuf dma_buf = set_buffer.dma_buf;
+    if (dma_buf.width != window->width
+        || dma_buf.height != window->height) {
+        response.status = WRSTATUS_INVALID_DMA_BUF_SIZE;
+        goto defer;
+    }
+
+    bool ok = window_set_buffer(window, set_buffer.buffer, (WindowDmaBuf) {
+        .present = true,
+        .fd = dma_buf_fd,
+        .width = dma_buf.width,
+        .height = dma_buf.height,
+        .format = dma_buf.format,
+        .stride = dma_buf.stride,
+    });
+    if (!ok)
+        response.status = WRSTATUS_BUFFER_BUSY;
+
+    // Not shown until it's committed, so nothing changed on screen
+
 defer:
     server_unlock_windows(server);
     return response;
 }
 
-static bool receive_command(int client_fd, WindowRendererCommand* command, int* received_fd)
+static WindowRendererResponse server_commit_window(Server* server, Client* client,
+                                                   WindowRendererCommitWindow commit,
+                                                   int acquire_fence)
 {
-    struct msghdr message_header = { 0 };
+    uint64_t trace_begin = trace_now();
 
-    char control_message_buffer[CMSG_SPACE(sizeof(*received_fd))];
-    memset(control_message_buffer, 0, sizeof(control_message_buffer));
+    server_lock_windows(server);
 
-    struct iovec io_vector = {
-        .iov_base = command,
-        .iov_len = sizeof(*command),
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_OK,
     };
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
 
-    message_header.msg_control = control_message_buffer;
-    message_header.msg_controllen = sizeof(control_message_buffer);
+    Window* window = server_find_client_window(server, client, commit.window_id);
+    if (!window) {
+        response.status = WRSTATUS_INVALID_WINID;
+        goto defer;
+    }
+
+    if (commit.buffer >= WR_WINDOW_BUFFERS_MAX) {
+        response.status = WRSTATUS_INVALID_BUFFER;
+        goto defer;
+    }
+
+    response.status = window_commit(window, commit.buffer,
+                                    (WindowRect) { commit.x, commit.y, commit.width, commit.height },
+                                    acquire_fence);
+    if (response.status == WRSTATUS_OK)
+        server_mark_windows_changed(server);
+
+defer:
+    server_unlock_windows(server);
+
+    if (response.status == WRSTATUS_OK)
+        trace_record(TRACE_COMMIT, trace_begin, trace_now(), commit.window_id);
+    return response;
+}
+
+static WindowRendererResponse server_damage_window(Server* server, Client* client,
+                                                   WindowRendererDamageWindow damage)
+{
+    server_lock_windows(server);
+
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_OK,
+    };
+
+    Window* window = server_find_client_window(server, client, damage.window_id);
+    if (!window) {
+        response.status = WRSTATUS_INVALID_WINID;
+        goto defer;
+    }
+
+    window_damage(window, (WindowRect) { damage.x, damage.y, damage.width, damage.height });
+    server_mark_windows_changed(server);
+
+defer:
+    server_unlock_windows(server);
+    return response;
+}
+
+static WindowRendererResponse server_request_frame(Server* server, Client* client,
+                                                   WindowRendererRequestFrame request)
+{
+    server_lock_windows(server);
+
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_OK,
+    };
+
+    Window* window = server_find_client_window(server, client, request.window_id);
+    if (!window) {
+        response.status = WRSTATUS_INVALID_WINID;
+        goto defer;
+    }
+
+    atomic_store(&window->frame_requested, true);
+    server_mark_windows_changed(server);
+
+defer:
+    server_unlock_windows(server);
+    return response;
+}
+
+// Event ring notifications are registered in epoll with the client
+// pointer, tagged with this bit to tell them apart from the socket
+#define EVENT_RING_TAG_BIT ((uintptr_t)1)
+
+static WindowRendererResponse server_set_event_ring(Server* server, Client* client,
+                                                    uint32_t capacity,
+                                                    int const* fds, size_t fds_count)
+{
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_INVALID_EVENT_RING,
+    };
+
+    if (client->event_ring) {
+        log_log(LOG_ERROR, "  => ERROR: the client already has an event ring");
+        return response;
+    }
+
+    if (fds_count != 3 || fds[0] == -1 || fds[1] == -1 || fds[2] == -1) {
+        log_log(LOG_ERROR, "  => ERROR: expected a memfd and two eventfds");
+        return response;
+    }
+
+    if (capacity == 0 || capacity > WR_EVENT_RING_CAPACITY_MAX
+        || (capacity & (capacity - 1)) != 0) {
+        log_log(LOG_ERROR, "  => ERROR: invalid event ring capacity %u", capacity);
+        return response;
+    }
+
+    // Without this seal, the client could shrink the memfd and crash
+    // us with SIGBUS as soon as we write to the ring
+    int seals = fcntl(fds[0], F_GET_SEALS);
+    if (seals == -1 || !(seals & F_SEAL_SHRINK)) {
+        log_log(LOG_ERROR, "  => ERROR: the event ring memfd is not sealed against shrinking");
+        return response;
+    }
+
+    size_t size = sizeof(WindowRendererEventRing) + capacity * sizeof(WindowRendererEvent);
+
+    struct stat memfd_stat;
+    if (fstat(fds[0], &memfd_stat) == -1 || (size_t)memfd_stat.st_size < size) {
+        log_log(LOG_ERROR, "  => ERROR: the event ring memfd is too small");
+        return response;
+    }
+
+    WindowRendererEventRing* ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         fds[0], 0);
+    if (ring == MAP_FAILED) {
+        log_log(LOG_ERROR, "  => ERROR: could not map event ring: %s", strerror(errno));
+        return response;
+    }
+
+    // Written from the dispatcher thread, which must not block on it
+    int wakeup_flags = fcntl(fds[1], F_GETFL);
+    if (wakeup_flags == -1 || fcntl(fds[1], F_SETFL, wakeup_flags | O_NONBLOCK) == -1) {
+        log_log(LOG_ERROR, "  => ERROR: could not make the wakeup eventfd non-blocking: %s",
+                strerror(errno));
+        munmap(ring, size);
+        return response;
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data = { .ptr = (void*)((uintptr_t)client | EVENT_RING_TAG_BIT) },
+    };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fds[2], &event) == -1) {
+        log_log(LOG_ERROR, "  => ERROR: could not watch event ring eventfd: %s",
+                strerror(errno));
+        munmap(ring, size);
+        return response;
+    }
+
+    // The mapping keeps the memory alive
+    close(fds[0]);
+
+    client_set_event_ring(client, ring, size, capacity, fds[1], fds[2]);
+
+    response.status = WRSTATUS_OK;
+    return response;
+}
+
+typedef enum {
+    RECEIVE_OK,
+    // Nothing left to read right now
+    RECEIVE_AGAIN,
+    // The connection was closed or is broken
+    RECEIVE_CLOSED,
+} ReceiveStatus;
 
-    int num_bytes_received = recvmsg(client_fd, &message_header, 0);
+// Amount of messages read by a single `recvmmsg` call, and the most
+// bytes read into each of them
+#define RECEIVE_SLOTS 16
+#define RECEIVE_SLOT_SIZE 512
+
+/*
+ * Appends whatever the client sent to its receive buffer, and its file
+ * descriptors to its descriptor queue.
+ *
+ * On a stream socket a read may stop short (e.g. right after a message
+ * carrying file descriptors), so the slots are compacted afterwards and
+ * parsed as a plain byte stream of frames.
+ */
+static ReceiveStatus receive_commands(Client* client)
+{
+    const size_t slot_size = RECEIVE_SLOT_SIZE;
+
+    unsigned char* buffer = client_reserve_receive_buffer(client, slot_size * RECEIVE_SLOTS);
+
+    struct mmsghdr messages[RECEIVE_SLOTS];
+    struct iovec io_vectors[RECEIVE_SLOTS];
+    char control_message_buffers[RECEIVE_SLOTS][CMSG_SPACE(sizeof(int) * WR_BATCH_COMMANDS_MAX
+                                                           * WR_COMMAND_FDS_MAX)];
+
+    memset(messages, 0, sizeof(messages));
+
+    for (size_t i = 0; i < RECEIVE_SLOTS; ++i) {
+        io_vectors[i] = (struct iovec) {
+            .iov_base = buffer + i * slot_size,
+            .iov_len = slot_size,
+        };
+        messages[i].msg_hdr.msg_iov = &io_vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_control = control_message_buffers[i];
+        messages[i].msg_hdr.msg_controllen = sizeof(control_message_buffers[i]);
+    }
+
+    int messages_count = recvmmsg(client->fd, messages, RECEIVE_SLOTS,
+                                  MSG_DONTWAIT | MSG_CMSG_CLOEXEC, NULL);
+
+    if (messages_count == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return RECEIVE_AGAIN;
 
-    if (num_bytes_received == -1) {
         log_log(LOG_ERROR, "Could not receive bytes from socket: %s",
                 strerror(errno));
-        return false;
+        return RECEIVE_CLOSED;
     }
 
-    if (num_bytes_received == 0) {
-        log_log(LOG_INFO, "Connection closed by client");
-        return false;
+    bool closed = false;
+    size_t received = 0;
+
+    for (int i = 0; i < messages_count; ++i) {
+        struct msghdr* header = &messages[i].msg_hdr;
+
+        for (struct cmsghdr* control_message = CMSG_FIRSTHDR(header);
+             control_message;
+             control_message = CMSG_NXTHDR(header, control_message)) {
+            if (control_message->cmsg_level != SOL_SOCKET
+                || control_message->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            size_t fds_count = (control_message->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t j = 0; j < fds_count; ++j) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(control_message) + j * sizeof(int), sizeof(fd));
+                client_push_fd(client, fd);
+            }
+        }
+
+        if (header->msg_flags & MSG_CTRUNC) {
+            log_log(LOG_ERROR, "Client sent too many file descriptors at once");
+            closed = true;
+        }
+
+        if (messages[i].msg_len == 0) {
+            log_log(LOG_INFO, "Connection closed by client");
+            closed = true;
+            break;
+        }
+
+        memmove(buffer + received, io_vectors[i].iov_base, messages[i].msg_len);
+        received += messages[i].msg_len;
     }
 
-    if (message_header.msg_controllen > 0) {
-        struct cmsghdr* control_message = CMSG_FIRSTHDR(&message_header);
-        if (control_message
-            && control_message->cmsg_level == SOL_SOCKET
-            && control_message->cmsg_type == SCM_RIGHTS) {
-            memcpy(received_fd, CMSG_DATA(control_message), sizeof(*received_fd));
-        } else {
-            *received_fd = -1;
+    client->receive_size += received;
+
+    if (closed)
+        return RECEIVE_CLOSED;
+
+    // A full read means there may be more data waiting
+    return messages_count == RECEIVE_SLOTS ? RECEIVE_OK : RECEIVE_AGAIN;
+}
+
+// Maximum amount of responses waiting to be sent at once
+#define RESPONSES_MAX 256
+
+/*
+ * Encoded responses of the commands handled in one go, sent with a
+ * single `sendmmsg` call. Each message is a run of consecutive response
+ * frames: a single response, or a batch response followed by its
+ * sub-responses.
+ */
+typedef struct {
+    unsigned char data[RESPONSES_MAX * WIRE_RESPONSE_SIZE_MAX];
+    size_t size;
+    size_t responses_count;
+
+    size_t message_starts[RESPONSES_MAX];
+    size_t messages_count;
+} ResponseQueue;
+
+/*
+ * Sends the queued responses without blocking. Whatever the socket
+ * doesn't take goes to the client's outbox, to be sent once it has room
+ * again. Returns false if the connection is broken.
+ */
+static bool response_queue_flush(ResponseQueue* queue, Client* client)
+{
+    struct mmsghdr messages[RESPONSES_MAX];
+    struct iovec io_vectors[RESPONSES_MAX];
+
+    size_t sent_size = 0;
+    bool ok = true;
+
+    // Responses can't overtake the ones waiting in the outbox
+    if (client->outbox_size != 0)
+        goto defer;
+
+    memset(messages, 0, queue->messages_count * sizeof(*messages));
+
+    for (size_t i = 0; i < queue->messages_count; ++i) {
+        size_t start = queue->message_starts[i];
+        size_t end = i + 1 < queue->messages_count
+            ? queue->message_starts[i + 1]
+            : queue->size;
+
+        io_vectors[i] = (struct iovec) {
+            .iov_base = &queue->data[start],
+            .iov_len = end - start,
+        };
+        messages[i].msg_hdr.msg_iov = &io_vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while (sent < queue->messages_count) {
+        int sent_now = sendmmsg(client->fd, &messages[sent], queue->messages_count - sent,
+                                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent_now == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            log_log(LOG_ERROR, "Could not send data to the client: %s",
+                    strerror(errno));
+            ok = false;
+            goto defer;
+        }
+
+        for (int i = 0; i < sent_now; ++i) {
+            sent_size += messages[sent + i].msg_len;
         }
-    } else {
-        *received_fd = -1;
+        sent += sent_now;
+
+        // Only part of the last message fit, the socket is full
+        if (messages[sent - 1].msg_len < io_vectors[sent - 1].iov_len)
+            break;
     }
 
-    return true;
+defer:
+    if (ok)
+        client_append_outbox(client, &queue->data[sent_size], queue->size - sent_size);
+
+    queue->size = 0;
+    queue->responses_count = 0;
+    queue->messages_count = 0;
+
+    return ok;
 }
 
-static bool send_response(int client_fd, WindowRendererResponse response)
+// Starts a message of `count` responses, which are then added with
+// `response_queue_push`
+static void response_queue_begin_message(ResponseQueue* queue, size_t count, Client* client,
+                                         bool* failed)
 {
-    struct msghdr message_header = { 0 };
+    if (queue->responses_count + count > RESPONSES_MAX) {
+        if (!response_queue_flush(queue, client))
+            *failed = true;
+    }
+
+    queue->message_starts[queue->messages_count++] = queue->size;
+}
+
+static void response_queue_push(ResponseQueue* queue, WindowRendererResponse response)
+{
+    queue->size += wire_encode_response(&queue->data[queue->size], &response);
+    queue->responses_count += 1;
+}
+
+// Answers a command that couldn't be decoded or isn't allowed where it
+// was sent, dropping the file descriptors sent along with it
+static WindowRendererResponse server_reject_command(Client* client,
+                                                    WindowRendererCommand* command)
+{
+    // A bogus count can't make us pop more than any command could have
+    uint32_t fd_count = command->fd_count < WR_COMMAND_FDS_MAX
+        ? command->fd_count
+        : WR_COMMAND_FDS_MAX;
+    for (uint32_t i = 0; i < fd_count; ++i) {
+        int fd = client_pop_fd(client);
+        if (fd != -1)
+            close(fd);
+    }
+
+    return (WindowRendererResponse) {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_INVALID_COMMAND,
+        .request_id = command->request_id,
+    };
+}
 
-    struct iovec io_vector = {
-        .iov_base = &response,
-        .iov_len = sizeof(response),
+static WindowRendererResponse server_execute_command(Server* server, Client* client,
+                                                     WindowRendererCommand* command)
+{
+    WindowRendererResponse response = {
+        .kind = WRRESP_EMPTY,
+        .status = WRSTATUS_OK,
     };
 
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
+    int command_fds[WR_COMMAND_FDS_MAX];
+    size_t command_fds_count = 0;
+    for (uint32_t i = 0; i < command->fd_count; ++i) {
+        int fd = client_pop_fd(client);
+        if (fd == -1)
+            continue;
 
-    if (sendmsg(client_fd, &message_header, 0) == -1) {
-        log_log(LOG_ERROR, "Could not send data to the client: %s",
-                strerror(errno));
-        return false;
+        if (command_fds_count < WR_COMMAND_FDS_MAX)
+            command_fds[command_fds_count++] = fd;
+        else
+            close(fd);
+    }
+    int command_fd = command_fds_count != 0 ? command_fds[0] : -1;
+
+    log_log(LOG_INFO, "Received command");
+
+    switch (command->kind) {
+
+    case WRCMD_CREATE_WINDOW:
+        log_log(LOG_INFO, "  > WRCMD_CREATE_WINDOW");
+        response = server_create_window(server, client,
+                                        command->command.create_window.title,
+                                        command->command.create_window.width,
+                                        command->command.create_window.height);
+        break;
+
+    case WRCMD_CLOSE_WINDOW:
+        log_log(LOG_INFO, "  > WRCMD_CLOSE_WINDOW");
+        response = server_close_window(server, client,
+                                       command->command.close_window.window_id);
+        break;
+
+    case WRCMD_SET_WINDOW_DMA_BUF:
+        log_log(LOG_INFO, "  > WRCMD_SET_WINDOW_DMA_BUF");
+        response = server_set_window_dma_buf(server, client,
+                                             command->command.set_window_dma_buf.window_id,
+                                             command->command.set_window_dma_buf.dma_buf,
+                                             command_fd);
+        break;
+
+    case WRCMD_SET_EVENT_RING:
+        log_log(LOG_INFO, "  > WRCMD_SET_EVENT_RING");
+        response = server_set_event_ring(server, client,
+                                         command->command.set_event_ring.capacity,
+                                         command_fds, command_fds_count);
+        break;
+
+    case WRCMD_DAMAGE_WINDOW:
+        log_log(LOG_INFO, "  > WRCMD_DAMAGE_WINDOW");
+        response = server_damage_window(server, client, command->command.damage_window);
+        break;
+
+    case WRCMD_REQUEST_FRAME:
+        log_log(LOG_INFO, "  > WRCMD_REQUEST_FRAME");
+        response = server_request_frame(server, client, command->command.request_frame);
+        break;
+
+    case WRCMD_SET_WINDOW_BUFFER:
+        log_log(LOG_INFO, "  > WRCMD_SET_WINDOW_BUFFER");
+        response = server_set_window_buffer(server, client,
+                                            command->command.set_window_buffer,
+                                            command_fd);
+        break;
+
+    case WRCMD_COMMIT_WINDOW:
+        log_log(LOG_INFO, "  > WRCMD_COMMIT_WINDOW");
+        response = server_commit_window(server, client, command->command.commit_window,
+                                        command_fd);
+        break;
+
+    default:
+        log_log(LOG_ERROR, "  => ERROR: unknown command `%d`", command->kind);
+        response.status = WRSTATUS_INVALID_COMMAND;
     }
 
-    return true;
+    // File descriptors are only kept on success
+    if (response.status != WRSTATUS_OK) {
+        for (size_t i = 0; i < command_fds_count; ++i) {
+            close(command_fds[i]);
+        }
+    }
+
+    response.request_id = command->request_id;
+
+    return response;
 }
 
-typedef struct {
-    int client_fd;
-    Server* server;
-} HandleClientInfo;
+static void server_add_client(Server* server, Client* client)
+{
+    if (server->clients_count == server->clients_capacity) {
+        server->clients_capacity = server->clients_capacity == 0
+            ? 16
+            : server->clients_capacity * 2;
+        server->clients = realloc(server->clients,
+                                  server->clients_capacity * sizeof(*server->clients));
+    }
 
-static void* server_handle_client(HandleClientInfo* info)
+    client->index = server->clients_count;
+    server->clients[server->clients_count++] = client;
+}
+
+static void server_remove_client(Server* server, Client* client)
 {
-    Server* server = info->server;
-    int cfd = info->client_fd;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    if (client->event_ring)
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->event_ring_space_fd, NULL);
+
+    // The client's windows can't outlive the connection their events
+    // are sent on
+    server_lock_windows(server);
+    for (size_t i = server->windows_count; i-- > 0;) {
+        Window* window = server->windows[i];
+        if (window->client == client) {
+            server_remove_window(server, window);
+            window_unref(window);
+        }
+    }
+    server_unlock_windows(server);
 
+    Client* last = server->clients[--server->clients_count];
+    server->clients[client->index] = last;
+    last->index = client->index;
+
+    client->closed = true;
+
+    if (server->closed_clients_count == server->closed_clients_capacity) {
+        server->closed_clients_capacity = server->closed_clients_capacity == 0
+            ? 16
+            : server->closed_clients_capacity * 2;
+        server->closed_clients = realloc(server->closed_clients,
+                                         server->closed_clients_capacity
+                                             * sizeof(*server->closed_clients));
+    }
+    server->closed_clients[server->closed_clients_count++] = client;
+
+    log_log(LOG_INFO, "Client disconnected");
+}
+
+static void server_destroy_closed_clients(Server* server)
+{
+    for (size_t i = 0; i < server->closed_clients_count; ++i) {
+        client_destroy(server->closed_clients[i]);
+    }
+    server->closed_clients_count = 0;
+}
+
+static void server_accept_clients(Server* server)
+{
+    // The listening socket is non-blocking, so drain the whole backlog.
+    // Client sockets are too, so that no client can block the dispatcher
     while (true) {
-        WindowRendererCommand command;
-        int command_fd;
+        int client_fd = accept4(server->socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_log(LOG_ERROR, "Could not accept connection: %s",
+                        strerror(errno));
+            }
+            return;
+        }
 
-        if (!receive_command(cfd, &command, &command_fd))
-            goto exit;
+        Client* client = client_create(client_fd);
 
-        WindowRendererResponse response = {
-            .kind = WRRESP_EMPTY,
-            .status = WRSTATUS_OK,
+        struct epoll_event event = {
+            .events = EPOLLIN,
+            .data = { .ptr = client },
         };
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1) {
+            log_log(LOG_ERROR, "Could not watch client socket: %s",
+                    strerror(errno));
+            client_destroy(client);
+            continue;
+        }
+        client->epoll_events = event.events;
 
-        log_log(LOG_INFO, "Received command");
+        server_add_client(server, client);
 
-        switch (command.kind) {
+        log_log(LOG_INFO, "Client connected");
+    }
+}
 
-        case WRCMD_CREATE_WINDOW:
-            log_log(LOG_INFO, "  > WRCMD_CREATE_WINDOW");
-            response = server_create_window(server,
-                                            command.command.create_window.title,
-                                            command.command.create_window.width,
-                                            command.command.create_window.height);
-            break;
+// Maximum amount of reads done for a client before moving on to the
+// next one, so that a single busy client can't starve the others
+#define MAX_RECEIVES_PER_WAKEUP 4
 
-        case WRCMD_CLOSE_WINDOW:
-            log_log(LOG_INFO, "  > WRCMD_CLOSE_WINDOW");
-            response = server_close_window(server, command.command.close_window.window_id);
-            break;
+// Returns false if the connection should be closed
+static bool server_handle_client(Server* server, Client* client, ResponseQueue* queue)
+{
+    bool failed = false;
 
-        case WRCMD_SET_WINDOW_DMA_BUF:
-            log_log(LOG_INFO, "  > WRCMD_SET_WINDOW_DMA_BUF");
-            response = server_set_window_dma_buf(server,
-                                                 command.command.set_window_dma_buf.window_id,
-                                                 command.command.set_window_dma_buf.dma_buf,
-                                                 command_fd);
+    for (size_t i = 0; i < MAX_RECEIVES_PER_WAKEUP; ++i) {
+        ReceiveStatus status = receive_commands(client);
+        if (status == RECEIVE_CLOSED)
+            return false;
+
+        // Handle every whole command (or whole batch) received so far
+        size_t offset = 0;
+        while (true) {
+            unsigned char const* frame = client->receive_buffer + offset;
+            size_t available = client->receive_size - offset;
+
+            size_t frame_size;
+            WindowRendererFrameStatus frame_status = wr_check_frame(frame, available, &frame_size);
+            if (frame_status == WR_FRAME_INCOMPLETE)
+                break;
+            if (frame_status == WR_FRAME_INVALID) {
+                log_log(LOG_ERROR, "Received an invalid frame, closing the connection");
+                return false;
+            }
+
+            WindowRendererCommand command;
+            bool decoded = wire_decode_command(frame, &command);
+
+            if (!decoded || command.kind != WRCMD_BATCH) {
+                if (!decoded)
+                    log_log(LOG_ERROR, "  => ERROR: malformed command of kind `%d`", command.kind);
+
+                response_queue_begin_message(queue, 1, client, &failed);
+                response_queue_push(queue, decoded
+                                        ? server_execute_command(server, client, &command)
+                                        : server_reject_command(client, &command));
+                offset += frame_size;
+                continue;
+            }
+
+            uint32_t count = command.command.batch.count;
+            if (count > WR_BATCH_COMMANDS_MAX) {
+                log_log(LOG_ERROR, "Received batch of %u commands, the maximum is %d",
+                        count, WR_BATCH_COMMANDS_MAX);
+                return false;
+            }
+
+            // The whole batch has to be here before it is handled
+            size_t batch_size = frame_size;
+            for (uint32_t j = 0; j < count && frame_status == WR_FRAME_OK; ++j) {
+                size_t sub_frame_size;
+                frame_status = wr_check_frame(frame + batch_size, available - batch_size,
+                                             &sub_frame_size);
+                batch_size += frame_status == WR_FRAME_OK ? sub_frame_size : 0;
+            }
+            if (frame_status == WR_FRAME_INCOMPLETE)
+                break;
+            if (frame_status == WR_FRAME_INVALID) {
+                log_log(LOG_ERROR, "Received an invalid frame, closing the connection");
+                return false;
+            }
+
+            log_log(LOG_INFO, "Received batch of %u commands", count);
+
+            response_queue_begin_message(queue, count + 1, client, &failed);
+            response_queue_push(queue, (WindowRendererResponse) {
+                                           .kind = WRRESP_BATCH,
+                                           .status = WRSTATUS_OK,
+                                           .request_id = command.request_id,
+                                           .response = {
+                                               .batch = { .count = count },
+                                           },
+                                       });
+
+            size_t sub_offset = frame_size;
+            for (uint32_t j = 0; j < count; ++j) {
+                size_t sub_frame_size = 0;
+                wr_check_frame(frame + sub_offset, available - sub_offset, &sub_frame_size);
+
+                WindowRendererCommand sub_command;
+                bool sub_decoded = wire_decode_command(frame + sub_offset, &sub_command);
+                sub_offset += sub_frame_size;
+
+                if (!sub_decoded || sub_command.kind == WRCMD_BATCH) {
+                    log_log(LOG_ERROR, sub_decoded
+                                ? "  => ERROR: nested batches are not allowed"
+                                : "  => ERROR: malformed command in batch");
+                    response_queue_push(queue, server_reject_command(client, &sub_command));
+                    continue;
+                }
+
+                response_queue_push(queue, server_execute_command(server, client, &sub_command));
+            }
+
+            offset += batch_size;
+        }
+        client_consume_receive_buffer(client, offset);
+
+        if (failed)
+            return false;
+
+        // Reading stops until the client takes the responses it has
+        if (status == RECEIVE_AGAIN || client->outbox_size != 0)
             break;
+    }
+
+    return response_queue_flush(queue, client);
+}
+
+/*
+ * Commands are read unless responses are waiting in the outbox, and the
+ * socket is waited on to have room while responses or events are
+ * waiting for it.
+ */
+static void server_watch_client(Server* server, Client* client)
+{
+    bool outbox_waiting = client->outbox_size != 0;
+    bool events_waiting = client->events_blocked && !client->event_ring;
+
+    uint32_t events = (outbox_waiting ? 0 : EPOLLIN)
+        | (outbox_waiting || events_waiting ? EPOLLOUT : 0);
+    if (events == client->epoll_events)
+        return;
+
+    struct epoll_event event = {
+        .events = events,
+        .data = { .ptr = client },
+    };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) == -1) {
+        log_log(LOG_ERROR, "Could not watch client socket: %s",
+                strerror(errno));
+        return;
+    }
+    client->epoll_events = events;
+}
+
+// Returns false if the client's socket can't take the event right now
+static bool send_event(Client* client, WindowRendererEvent event)
+{
+    // Would end up in the middle of a response
+    if (client->outbox_size != 0)
+        return false;
+
+    unsigned char frame[WIRE_MESSAGE_SIZE_MAX];
+    size_t frame_size = wire_encode_event(frame, &event);
+
+    // A message this small is either sent whole or not at all, so a
+    // non-blocking send can't leave half a message in the stream
+    if (send(client->fd, frame, frame_size, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+        // A broken connection is dealt with once epoll reports it. Until
+        // then, delivery is blocked just like for a full socket
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EPIPE && errno != ECONNRESET)
+            log_log(LOG_ERROR, "Could not send event to the client: %s",
+                    strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static void server_deliver_window_events(Server* server, Window* window)
+{
+    Client* client = window->client;
+
+    // The events stay queued until `server_resume_events`, and the window
+    // stays reported so that new events don't wake us up meanwhile
+    if (client->events_blocked)
+        return;
+
+    uint64_t trace_begin = trace_now();
 
-        default:
-            log_log(LOG_ERROR, "  => ERROR: unknown command `%d`", command.kind);
-            response.status = WRSTATUS_INVALID_COMMAND;
+    window_begin_event_delivery(window);
+
+    bool delivered = false;
+
+    WindowRendererEvent event;
+    while (event_list_claim(&window->event_list, &event)) {
+        bool sent = client->event_ring
+            ? client_push_ring_event(client, event)
+            : send_event(client, event);
+
+        if (!sent) {
+            event_list_release(&window->event_list);
+
+            // Ring clients write to their eventfd once they make room
+            client->events_blocked = true;
+            server_watch_client(server, client);
+            break;
         }
 
-        if (!send_response(cfd, response))
+        event_list_pop(&window->event_list);
+        delivered = true;
+    }
+
+    if (delivered && client->event_ring)
+        client_wake_event_ring(client);
+
+    if (delivered)
+        trace_record(TRACE_EVENT_DELIVERY, trace_begin, trace_now(), window->id);
+}
+
+static void server_deliver_events(Server* server, int const* window_ids, size_t window_ids_count)
+{
+    server_lock_windows(server);
+
+    for (size_t i = 0; i < window_ids_count; ++i) {
+        // The window may have been closed since it was reported
+        Window* window = window_table_get(&server->window_table, window_ids[i]);
+        if (!window)
             continue;
+
+        server_deliver_window_events(server, window);
     }
 
-exit:
-    close(cfd);
-    free(info);
-    log_log(LOG_INFO, "Exiting `handle_client` thread...");
-    return NULL;
+    server_unlock_windows(server);
+}
+
+/*
+ * Delivers what was left queued for `client` while its socket was full.
+ * Those windows were already reported and won't be reported again until
+ * their event lists are drained, so all of the client's windows are
+ * checked here.
+ */
+static void server_resume_events(Server* server, Client* client)
+{
+    client->events_blocked = false;
+
+    server_lock_windows(server);
+
+    for (size_t i = 0; i < server->windows_count && !client->events_blocked; ++i) {
+        Window* window = server->windows[i];
+        if (window->client == client)
+            server_deliver_window_events(server, window);
+    }
+
+    server_unlock_windows(server);
+
+    server_watch_client(server, client);
 }
 
-static void* server_listener(Server* server)
+// Sentinels stored in `epoll_event.data.ptr` for the non-client file descriptors
+static char listener_tag;
+static char wakeup_tag;
+
+#define MAX_EPOLL_EVENTS 64
+
+static void* server_dispatcher(Server* server)
 {
+    int* pending_window_ids = NULL;
+    size_t pending_window_ids_capacity = 0;
+
     if (listen(server->socket, LISTEN_QUEUE) == -1) {
         log_log(LOG_ERROR, "Could not listen to socket: %s",
                 strerror(errno));
         goto exit;
     }
 
-    while (true) {
-        log_log(LOG_INFO, "Waiting for connection...");
+    log_log(LOG_INFO, "Waiting for connections...");
 
-        struct sockaddr_un client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(server->socket, (struct sockaddr*)&client_addr,
-                               &client_len);
-        if (client_fd == -1) {
-            log_log(LOG_ERROR, "Could not accept connection: %s",
+    trace_name_thread("Dispatcher");
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    ResponseQueue response_queue = { 0 };
+
+    while (atomic_load(&server->dispatcher_thread_running)) {
+        int events_count = epoll_wait(server->epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+        if (events_count == -1) {
+            if (errno == EINTR)
+                continue;
+
+            log_log(LOG_ERROR, "Could not wait for socket events: %s",
                     strerror(errno));
-            continue;
+            goto exit;
         }
 
-        HandleClientInfo* info = malloc(sizeof(*info));
-        info->server = server;
-        info->client_fd = client_fd;
-
-        pthread_t handle_client_thread;
-        int status
-            = pthread_create(&handle_client_thread, NULL,
-                             (void* (*)(void*)) & server_handle_client, info);
-        if (status != 0) {
-            log_log(LOG_ERROR, "Could not create handle_client thread");
-            free(info);
-            continue;
+        for (int i = 0; i < events_count; ++i) {
+            void* tag = events[i].data.ptr;
+
+            if (tag == &wakeup_tag) {
+                uint64_t value;
+                if (read(server->wakeup_fd, &value, sizeof(value)) == -1)
+                    log_log(LOG_WARNING, "Could not read wakeup event: %s",
+                            strerror(errno));
+
+                size_t pending_window_ids_count = event_notifier_take(&server->event_notifier,
+                                                                      &pending_window_ids,
+                                                                      &pending_window_ids_capacity);
+                server_deliver_events(server, pending_window_ids, pending_window_ids_count);
+                continue;
+            }
+
+            if (tag == &listener_tag) {
+                server_accept_clients(server);
+                continue;
+            }
+
+            Client* client = (Client*)((uintptr_t)tag & ~EVENT_RING_TAG_BIT);
+            uint32_t flags = events[i].events;
+
+            // Removed while handling an earlier event of this round
+            if (client->closed)
+                continue;
+
+            if ((uintptr_t)tag & EVENT_RING_TAG_BIT) {
+                uint64_t value;
+                if (read(client->event_ring_space_fd, &value, sizeof(value)) == -1)
+                    log_log(LOG_WARNING, "Could not read event ring eventfd: %s",
+                            strerror(errno));
+
+                if (client->events_blocked)
+                    server_resume_events(server, client);
+                continue;
+            }
+
+            bool keep_client = true;
+            if (flags & EPOLLIN)
+                keep_client = server_handle_client(server, client, &response_queue);
+            else if (flags & (EPOLLHUP | EPOLLERR))
+                keep_client = false;
+
+            // Responses that were waiting go out before any event
+            if (keep_client && (flags & EPOLLOUT) && client->outbox_size != 0)
+                keep_client = client_send_outbox(client);
+
+            if (!keep_client) {
+                server_remove_client(server, client);
+                continue;
+            }
+
+            if ((flags & EPOLLOUT) && client->outbox_size == 0 && client->events_blocked
+                && !client->event_ring)
+                server_resume_events(server, client);
+            else
+                server_watch_client(server, client);
         }
-        pthread_detach(handle_client_thread);
+
+        server_destroy_closed_clients(server);
     }
 
 exit:
-    log_log(LOG_INFO, "Exiting `server_listener` thread...");
+    free(pending_window_ids);
+
+    log_log(LOG_INFO, "Exiting `server_dispatcher` thread...");
     return NULL;
 }
 
@@ -341,7 +1315,7 @@ bool server_run(Server* server)
         }
     }
 
-    server->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    server->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server->socket == -1) {
         log_log(LOG_ERROR, "Could not create socket: %s",
                 strerror(errno));
@@ -358,63 +1332,126 @@ bool server_run(Server* server)
                            sizeof(server_addr));
     if (bind_result == -1) {
         log_log(LOG_ERROR, "Could not bind socket: %s", strerror(errno));
-        close(server->socket);
-        return false;
+        goto fail;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd == -1) {
+        log_log(LOG_ERROR, "Could not create epoll instance: %s", strerror(errno));
+        goto fail;
     }
 
-    int status = pthread_create(&server->listener_thread, NULL,
-                                (void* (*)(void*)) & server_listener, server);
+    server->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wakeup_fd == -1) {
+        log_log(LOG_ERROR, "Could not create wakeup eventfd: %s", strerror(errno));
+        goto fail;
+    }
+    server->event_notifier.wakeup_fd = server->wakeup_fd;
+
+    server->windows_changed_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->windows_changed_fd == -1) {
+        log_log(LOG_ERROR, "Could not create window change eventfd: %s", strerror(errno));
+        goto fail;
+    }
+
+    struct epoll_event listener_event = {
+        .events = EPOLLIN,
+        .data = { .ptr = &listener_tag },
+    };
+    struct epoll_event wakeup_event = {
+        .events = EPOLLIN,
+        .data = { .ptr = &wakeup_tag },
+    };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->socket, &listener_event) == -1
+        || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wakeup_fd, &wakeup_event) == -1) {
+        log_log(LOG_ERROR, "Could not watch server sockets: %s", strerror(errno));
+        goto fail;
+    }
+
+    atomic_store(&server->dispatcher_thread_running, true);
+    int status = pthread_create(&server->dispatcher_thread, NULL,
+                                (void* (*)(void*)) & server_dispatcher, server);
     if (status != 0) {
-        log_log(LOG_ERROR, "Could not create listener thread");
-        close(server->socket);
-        return false;
+        log_log(LOG_ERROR, "Could not create dispatcher thread");
+        atomic_store(&server->dispatcher_thread_running, false);
+        goto fail;
     }
-    pthread_detach(server->listener_thread);
 
     return true;
-}
 
-void server_lock_windows(Server* server)
-{
-    pthread_mutex_lock(&server->windows_mutex);
+fail:
+    if (server->windows_changed_fd != -1) {
+        close(server->windows_changed_fd);
+        server->windows_changed_fd = -1;
+    }
+    if (server->wakeup_fd != -1) {
+        close(server->wakeup_fd);
+        server->wakeup_fd = -1;
+    }
+    if (server->epoll_fd != -1) {
+        close(server->epoll_fd);
+        server->epoll_fd = -1;
+    }
+    close(server->socket);
+    server->socket = -1;
+    return false;
 }
 
-void server_unlock_windows(Server* server)
+WindowStack* server_acquire_windows(Server* server)
 {
-    pthread_mutex_unlock(&server->windows_mutex);
+    server_lock_windows(server);
+
+    if (!server->windows_snapshot)
+        server->windows_snapshot = window_stack_create(server->windows, server->windows_count);
+
+    WindowStack* stack = server->windows_snapshot;
+    window_stack_ref(stack);
+
+    server_unlock_windows(server);
+
+    return stack;
 }
 
-Window** server_get_windows(Server* server)
+bool server_raise_window(Server* server, Window* window)
 {
-    return server->windows;
+    server_lock_windows(server);
+
+    bool ok = window_table_get(&server->window_table, window->id) == window;
+    if (ok) {
+        server_unstack_window(server, window);
+        server_push_window(server, window);
+    }
+
+    server_unlock_windows(server);
+
+    // The window was closed since the caller got it
+    if (!ok)
+        log_log(LOG_ERROR, "Failed to raise window of id `%d`", window->id);
+
+    return ok;
 }
 
-size_t server_get_window_count(Server* server)
+int server_get_windows_changed_fd(Server* server)
 {
-    return server->windows_count;
+    return server->windows_changed_fd;
 }
 
-Window* server_top_window(Server* server)
+bool server_take_windows_changed(Server* server)
 {
-    return server->windows[server->windows_count - 1];
+    // Drained before the flag is cleared, so changes made after this
+    // write the eventfd again
+    uint64_t value;
+    if (read(server->windows_changed_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        log_log(LOG_WARNING, "Could not read window change eventfd: %s", strerror(errno));
+
+    return atomic_exchange(&server->windows_changed, false);
 }
 
-/*
- * WARNING: this function DOES NOT lock window access. You'll have to lock
- * it yourself.
- *
- * Returns false on error.
- */
-bool server_raise_window(Server* server, Window* window)
+LockStats server_get_windows_lock_stats(Server* server)
 {
-    int index = server_find_window(server, window->id);
-    if (index == -1) {
-        log_log(LOG_ERROR, "Failed to raise window of id `%d`", window->id);
-        return false;
-    }
-
-    server_remove_window(server, index);
-    server->windows[server->windows_count++] = window;
+    server_lock_windows(server);
+    LockStats stats = server->windows_lock_stats;
+    server_unlock_windows(server);
 
-    return true;
+    return stats;
 }
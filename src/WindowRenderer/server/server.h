@@ -1,22 +1,74 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include "client.h"
+#include "event_notifier.h"
 #include "window.h"
+#include "window_stack.h"
+#include "window_table.h"
 
-// Why would you want to open 1024 windows?
-#define MAX_WINDOWS 1024
+// Times are in nanoseconds
+typedef struct {
+    size_t count;
+    uint64_t wait_total;
+    uint64_t wait_max;
+    uint64_t hold_total;
+    uint64_t hold_max;
+} LockStats;
 
 typedef struct {
     int socket;
     char* socket_path;
 
-    pthread_t listener_thread;
+    int epoll_fd;
+    // Written to wake the dispatcher thread up, on shutdown or when
+    // window events are waiting to be delivered
+    int wakeup_fd;
+
+    // Windows with events waiting to be delivered
+    EventNotifier event_notifier;
+
+    // Cleared by `server_destroy` to stop the dispatcher thread
+    atomic_bool dispatcher_thread_running;
+    pthread_t dispatcher_thread;
+
+    // Only accessed from the dispatcher thread
+    Client** clients;
+    size_t clients_count;
+    size_t clients_capacity;
 
+    // Removed clients waiting to be destroyed, see `Client.closed`
+    Client** closed_clients;
+    size_t closed_clients_count;
+    size_t closed_clients_capacity;
+
+    // Guards everything below. Never held for longer than a single
+    // command or a copy of the window stack
     pthread_mutex_t windows_mutex;
-    Window* windows[MAX_WINDOWS];
+    LockStats windows_lock_stats;
+    uint64_t windows_locked_at;
+
+    // Finds windows by ID
+    WindowTable window_table;
+    // Windows in stacking order, bottom to top
+    Window** windows;
     size_t windows_count;
+    size_t windows_capacity;
+
+    // Copy of `windows` handed out by `server_acquire_windows`. NULL when
+    // it's out of date, in which case the next call makes a new one
+    WindowStack* windows_snapshot;
+
+    // Set when windows are opened, closed, raised or damaged, or when
+    // their clients request a frame
+    atomic_bool windows_changed;
+    // Written when `windows_changed` gets set
+    int windows_changed_fd;
 } Server;
 
 Server* server_create(void);
@@ -25,18 +77,22 @@ void server_destroy(Server* server);
 // Returns false on error
 bool server_run(Server* server);
 
-void server_lock_windows(Server* server);
-void server_unlock_windows(Server* server);
-
-Window** server_get_windows(Server* server);
-size_t server_get_window_count(Server* server);
-
-Window* server_top_window(Server* server);
-
 /*
- * WARNING: this function DOES NOT lock window access. You'll have to lock
- *          it yourself.
- *
- * Returns false on error.
+ * Returns the current window stack. It doesn't change while it's being
+ * used: windows opened, closed or raised afterwards show up in the next
+ * one. Release it with `window_stack_unref`.
  */
+WindowStack* server_acquire_windows(Server* server);
+
+// Returns false on error
 bool server_raise_window(Server* server, Window* window);
+
+// Becomes readable when `windows_changed` gets set. Drained by
+// `server_take_windows_changed`
+int server_get_windows_changed_fd(Server* server);
+
+// Returns whether windows were opened, closed, raised or damaged since
+// the last call
+bool server_take_windows_changed(Server* server);
+
+LockStats server_get_windows_lock_stats(Server* server);
@@ -2,198 +2,280 @@
 
 #include "log.h"
 #include "event_list.h"
-#include "session.h"
 
-#include <errno.h>
 #include <fcntl.h>
-#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <sys/socket.h>
-#include <sys/stat.h>
-#include <sys/un.h>
 #include <unistd.h>
 
 #include "WindowRenderer/windowrenderer.h"
 
-#define LISTEN_QUEUE 20
+static atomic_uint_fast64_t next_buffer_serial = 1;
 
-static bool file_exists(char const* file_path)
+Window* window_create(Client* client, EventNotifier* event_notifier,
+                      char const* title, int width, int height)
 {
-    struct stat buf = { 0 };
-    return stat(file_path, &buf) == 0;
+    Window* window = malloc(sizeof(*window));
+    memset(window, 0, sizeof(*window));
+
+    atomic_init(&window->refs, 1);
+    pthread_mutex_init(&window->content_mutex, NULL);
+
+    window->id = -1;
+    window->shown_buffer = -1;
+    window->acquire_fence = -1;
+    window->title = strdup(title);
+    window->width = width;
+    window->height = height;
+
+    window->client = client;
+    window->event_notifier = event_notifier;
+
+    return window;
 }
 
-static bool send_event(int client_fd, WindowRendererEvent event)
+static void window_destroy(Window* window)
 {
-    struct msghdr message_header = { 0 };
+    WindowEventStats stats = window_get_event_stats(window);
+    log_log(LOG_INFO, "Window of ID %d coalesced %zu events and dropped %zu",
+            window->id, stats.coalesced, stats.dropped);
 
-    struct iovec io_vector = {
-        .iov_base = &event,
-        .iov_len = sizeof(event),
-    };
+    for (size_t i = 0; i < WR_WINDOW_BUFFERS_MAX; ++i) {
+        if (window->buffers[i].present)
+            close(window->buffers[i].fd);
+    }
+    if (window->acquire_fence != -1)
+        close(window->acquire_fence);
 
-    message_header.msg_iov = &io_vector;
-    message_header.msg_iovlen = 1;
+    pthread_mutex_destroy(&window->content_mutex);
+    free(window->title);
+    free(window);
+}
 
-    if (sendmsg(client_fd, &message_header, 0) == -1) {
-        log_log(LOG_ERROR, "Could not send data to the client: %s",
-                strerror(errno));
-        return false;
-    }
+void window_ref(Window* window)
+{
+    atomic_fetch_add_explicit(&window->refs, 1, memory_order_relaxed);
+}
 
-    return true;
+void window_unref(Window* window)
+{
+    if (atomic_fetch_sub_explicit(&window->refs, 1, memory_order_acq_rel) == 1)
+        window_destroy(window);
 }
 
-static void* event_listener(Window* window)
+static void window_add_damage(Window* window, WindowRect rect)
 {
-    int clientfd = -1;
+    // The rectangle comes from the client, its ends may not fit in an int
+    int64_t rect_x1 = (int64_t)rect.x + rect.width;
+    int64_t rect_y1 = (int64_t)rect.y + rect.height;
+
+    int x0 = rect.x < 0 ? 0 : rect.x;
+    int y0 = rect.y < 0 ? 0 : rect.y;
+    int x1 = rect_x1 > window->width ? window->width : (int)rect_x1;
+    int y1 = rect_y1 > window->height ? window->height : (int)rect_y1;
+    if (x0 >= x1 || y0 >= y1)
+        return;
 
-    if (listen(window->event_socket, LISTEN_QUEUE) == -1) {
-        log_log(LOG_ERROR, "Could not listen to socket: %s",
-                strerror(errno));
-        goto exit;
+    WindowRect* damage = &window->damage;
+    if (damage->width != 0 && damage->height != 0) {
+        if (damage->x < x0)
+            x0 = damage->x;
+        if (damage->y < y0)
+            y0 = damage->y;
+        if (damage->x + damage->width > x1)
+            x1 = damage->x + damage->width;
+        if (damage->y + damage->height > y1)
+            y1 = damage->y + damage->height;
     }
 
-    while (window->event_listener_thread_running) {
-        struct sockaddr_un client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        clientfd = accept(window->event_socket, (struct sockaddr*)&client_addr,
-                          &client_len);
-        if (clientfd == -1) {
-            log_log(LOG_ERROR, "Could not accept connection: %s",
-                    strerror(errno));
-            continue;
-        }
+    *damage = (WindowRect) { x0, y0, x1 - x0, y1 - y0 };
+}
 
-        log_log(LOG_INFO, "Client connected to event socket of window of ID %d",
-                window->id);
+// Called with `content_mutex` held
+static void window_put_buffer(Window* window, size_t buffer, WindowDmaBuf dma_buf)
+{
+    if (window->buffers[buffer].present)
+        close(window->buffers[buffer].fd);
+
+    dma_buf.serial = atomic_fetch_add_explicit(&next_buffer_serial, 1, memory_order_relaxed);
+    window->buffers[buffer] = dma_buf;
+}
 
-        break;
+// Called with `content_mutex` held
+static void window_show_buffer(Window* window, size_t buffer, int acquire_fence)
+{
+    if (window->acquire_fence != -1)
+        close(window->acquire_fence);
+    window->acquire_fence = acquire_fence;
+    window->commit += 1;
+
+    // Outputs may still be reading from the buffer shown before
+    if (window->shown_buffer != -1 && (size_t)window->shown_buffer != buffer) {
+        window->busy_buffers |= 1u << window->shown_buffer;
+        window->replaced_buffers |= 1u << window->shown_buffer;
     }
 
-    while (window->event_listener_thread_running) {
-        pthread_mutex_lock(&window->event_list_mutex);
+    window->shown_buffer = buffer;
+}
 
-        if (event_list_get_count(&window->event_list) != 0) {
-            WindowRendererEvent event = event_list_pop(&window->event_list);
-            send_event(clientfd, event);
-        }
+bool window_set_buffer(Window* window, size_t buffer, WindowDmaBuf dma_buf)
+{
+    pthread_mutex_lock(&window->content_mutex);
 
-        pthread_mutex_unlock(&window->event_list_mutex);
-    }
+    bool ok = window->shown_buffer != (int)buffer
+        && !(window->busy_buffers & (1u << buffer));
+    if (ok)
+        window_put_buffer(window, buffer, dma_buf);
 
-exit:
-    if (clientfd != -1)
-        close(clientfd);
+    pthread_mutex_unlock(&window->content_mutex);
 
-    log_log(LOG_INFO, "Exiting `event_listener` thread for window of ID %d...", window->id);
-    return NULL;
+    return ok;
 }
 
-Window* window_create(char const* title, int width, int height)
+WindowRendererStatus window_commit(Window* window, size_t buffer, WindowRect damage,
+                                   int acquire_fence)
 {
-    Window* window = malloc(sizeof(*window));
-    memset(window, 0, sizeof(*window));
+    pthread_mutex_lock(&window->content_mutex);
 
-    window->id = session_generate_window_id();
-    window->title = title;
-    window->width = width;
-    window->height = height;
+    WindowRendererStatus status = WRSTATUS_OK;
 
-    window->event_socket = -1;
+    if (!window->buffers[buffer].present) {
+        status = WRSTATUS_INVALID_BUFFER;
+    } else if (window->busy_buffers & (1u << buffer)) {
+        status = WRSTATUS_BUFFER_BUSY;
+    } else {
+        // The first buffer shown replaces the window's decorations
+        if (window->shown_buffer == -1)
+            damage = (WindowRect) { 0, 0, window->width, window->height };
 
-    pthread_mutex_init(&window->event_list_mutex, NULL);
+        window_show_buffer(window, buffer, acquire_fence);
+        window_add_damage(window, damage);
+    }
 
-    bool event_socket_failed = false;
+    pthread_mutex_unlock(&window->content_mutex);
 
-    char const* socket_path = session_generate_window_socket_name(window->id);
+    return status;
+}
 
-    if (file_exists(socket_path)) {
-        if (unlink(socket_path) != 0) {
-            log_log(LOG_WARNING, "Could not delete `%s`: %s",
-                    socket_path, strerror(errno));
-            event_socket_failed = true;
-            goto defer;
-        }
-    }
+void window_set_dma_buf(Window* window, WindowDmaBuf dma_buf)
+{
+    pthread_mutex_lock(&window->content_mutex);
+    window_put_buffer(window, 0, dma_buf);
+    window_show_buffer(window, 0, -1);
+    window_add_damage(window, (WindowRect) { 0, 0, window->width, window->height });
+    pthread_mutex_unlock(&window->content_mutex);
+}
 
-    window->event_socket = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (window->event_socket == -1) {
-        log_log(LOG_WARNING, "Could not create socket: %s",
-                strerror(errno));
-        event_socket_failed = true;
-        goto defer;
-    }
+WindowShownBuffer window_get_shown_buffer(Window* window, uint64_t waited_commit)
+{
+    pthread_mutex_lock(&window->content_mutex);
+
+    WindowShownBuffer shown = {
+        .commit = window->commit,
+        .acquire_fence = -1,
+    };
 
-    struct sockaddr_un server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sun_family = AF_UNIX;
-    strncpy(server_addr.sun_path, socket_path,
-            sizeof(server_addr.sun_path) - 1);
-
-    if (bind(window->event_socket, (struct sockaddr*)&server_addr,
-             sizeof(server_addr))
-        == -1) {
-        log_log(LOG_WARNING, "Could not bind socket: %s", strerror(errno));
-        event_socket_failed = true;
-        goto defer;
+    if (window->shown_buffer != -1) {
+        shown.dma_buf = window->buffers[window->shown_buffer];
+        shown.buffer = window->shown_buffer;
     }
 
-    window->event_listener_thread_running = true;
-    int status = pthread_create(&window->event_listener_thread, NULL,
-                                (void* (*)(void*)) & event_listener, window);
-    if (status != 0) {
-        log_log(LOG_ERROR, "Could not create event listener thread for window of ID %d",
-                window->id);
-        event_socket_failed = true;
-        window->event_listener_thread_running = false;
-        goto defer;
+    // Duplicated with the mutex held, since the next commit closes it
+    if (window->acquire_fence != -1 && window->commit != waited_commit) {
+        shown.acquire_fence = fcntl(window->acquire_fence, F_DUPFD_CLOEXEC, 0);
+        if (shown.acquire_fence == -1)
+            log_log(LOG_WARNING, "Could not duplicate acquire fence of window of ID %d",
+                    window->id);
     }
 
-defer:
-    if (event_socket_failed) {
-        if (window->event_socket != -1) {
-            close(window->event_socket);
-            window->event_socket = -1;
-        }
+    pthread_mutex_unlock(&window->content_mutex);
 
-        log_log(LOG_WARNING, "Failed to create event socket. "
-                             "Window of ID %d won't receive events",
-                window->id);
-    }
-    return window;
+    return shown;
 }
 
-void window_destroy(Window* window)
+uint32_t window_take_replaced_buffers(Window* window)
 {
-    if (window->event_listener_thread_running) {
-        window->event_listener_thread_running = false;
-        pthread_join(window->event_listener_thread, NULL);
-    }
-
-    pthread_mutex_destroy(&window->event_list_mutex);
+    pthread_mutex_lock(&window->content_mutex);
+    uint32_t buffers = window->replaced_buffers;
+    window->replaced_buffers = 0;
+    pthread_mutex_unlock(&window->content_mutex);
 
-    if (window->event_socket != -1) {
-        close(window->event_socket);
-    }
+    return buffers;
+}
 
-    free(window);
+void window_release_buffers(Window* window, uint32_t buffers)
+{
+    pthread_mutex_lock(&window->content_mutex);
+    window->busy_buffers &= ~buffers;
+    pthread_mutex_unlock(&window->content_mutex);
 }
 
 void window_send_event(Window* window, WindowRendererEvent event)
 {
-    if (!window->event_listener_thread_running) {
-        log_log(LOG_WARNING, "Window of ID %d is not listening to events. "
-                             "Not sending events...");
-        return;
-    }
-
     log_log(LOG_INFO, "Sending event of kind %d to window of ID %d",
             event.kind, window->id);
 
-    pthread_mutex_lock(&window->event_list_mutex);
-    event_list_push(&window->event_list, event);
-    pthread_mutex_unlock(&window->event_list_mutex);
+    event.window_id = window->id;
+
+    bool is_motion = event.kind == WREVENT_MOUSE_MOVE;
+
+    // Only the latest position matters, so a motion event that the
+    // client hasn't received yet is updated instead of queueing another
+    if (is_motion && event_list_replace_newest(&window->event_list, event)) {
+        atomic_fetch_add_explicit(&window->events_coalesced, 1, memory_order_relaxed);
+    } else {
+        size_t limit = is_motion ? WINDOW_MOTION_EVENTS_MAX : EVENT_LIST_MAX;
+
+        if (!event_list_push(&window->event_list, event, limit)) {
+            size_t dropped = atomic_fetch_add_explicit(&window->events_dropped, 1,
+                                                       memory_order_relaxed) + 1;
+            log_log(is_motion ? LOG_WARNING : LOG_ERROR,
+                    "Event list of window of ID %d is full, %zu events dropped so far",
+                    window->id, dropped);
+            return;
+        }
+    }
+
+    // Pairs with the fence in `window_begin_event_delivery`: either the
+    // dispatcher sees this event while draining, or we see the flag it
+    // cleared and report the window again
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // Otherwise the window was already reported and its events haven't
+    // been delivered yet, so this one will go out along with them
+    if (!atomic_exchange(&window->events_reported, true))
+        event_notifier_notify(window->event_notifier, window->id);
+}
+
+void window_begin_event_delivery(Window* window)
+{
+    atomic_store(&window->events_reported, false);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+WindowEventStats window_get_event_stats(Window* window)
+{
+    return (WindowEventStats) {
+        .coalesced = atomic_load_explicit(&window->events_coalesced, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&window->events_dropped, memory_order_relaxed),
+    };
+}
+
+void window_damage(Window* window, WindowRect rect)
+{
+    pthread_mutex_lock(&window->content_mutex);
+    window_add_damage(window, rect);
+    pthread_mutex_unlock(&window->content_mutex);
+}
+
+bool window_take_damage(Window* window, WindowRect* damage)
+{
+    pthread_mutex_lock(&window->content_mutex);
+
+    *damage = window->damage;
+    window->damage = (WindowRect) { 0 };
+
+    pthread_mutex_unlock(&window->content_mutex);
+
+    return damage->width != 0 && damage->height != 0;
 }
@@ -1,16 +1,22 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "WindowRenderer/windowrenderer.h"
 
+#include "client.h"
 #include "event_list.h"
+#include "event_notifier.h"
 
 typedef struct {
     bool present;
+    // Different for every buffer set, so that a buffer getting the file
+    // descriptor number of a closed one isn't mistaken for it
+    uint64_t serial;
 
     int fd;
     int width;
@@ -19,25 +25,137 @@ typedef struct {
     int stride;
 } WindowDmaBuf;
 
+/*
+ * How many events the event list can hold before motion events start
+ * being dropped. The rest is kept for button and close events, which are
+ * only dropped if the client stops reading altogether.
+ */
+#define WINDOW_MOTION_EVENTS_MAX (EVENT_LIST_MAX - EVENT_LIST_MAX / 4)
+
 typedef struct {
-    int id;
-    char const* title;
-    WindowDmaBuf dma_buf;
+    size_t coalesced;
+    size_t dropped;
+} WindowEventStats;
 
+// In pixels, from the top-left corner of the window's content
+typedef struct {
     int x;
     int y;
     int width;
     int height;
+} WindowRect;
+
+// What a window shows, see `window_get_shown_buffer`
+typedef struct {
+    // Not present if no buffer was committed yet
+    WindowDmaBuf dma_buf;
+    // Slot of `dma_buf`
+    size_t buffer;
+    uint64_t commit;
+    // A duplicate owned by the caller, or -1
+    int acquire_fence;
+} WindowShownBuffer;
+
+typedef struct {
+    // Held by the server while the window is open, and by every window
+    // stack snapshot the window is in
+    atomic_size_t refs;
+
+    // Assigned when the window is added to the server's window table
+    int id;
+    // Position in the server's window stack, bottom to top
+    size_t stack_index;
+    // Owned by the window
+    char* title;
+
+    // Set from the dispatcher thread and read while rendering, see
+    // `window_get_shown_buffer` and `window_take_damage`
+    pthread_mutex_t content_mutex;
+    // Owned by the window
+    WindowDmaBuf buffers[WR_WINDOW_BUFFERS_MAX];
+    // Slot of the buffer shown, -1 until one is committed
+    int shown_buffer;
+    // Different for every commit
+    uint64_t commit;
+    // Signaled once the client finished drawing into the buffer shown.
+    // -1 if the commit didn't come with one
+    int acquire_fence;
+    // Bit `i` is set from when buffer `i` stops being shown until it's
+    // released. It can't be replaced or committed meanwhile
+    uint32_t busy_buffers;
+    // Busy buffers not taken by `window_take_replaced_buffers` yet
+    uint32_t replaced_buffers;
+    // Part of the content that changed since it was last taken. Empty
+    // if `width` or `height` is 0
+    WindowRect damage;
+
+    // Set by WRCMD_REQUEST_FRAME, taken by the main thread along with
+    // the damage. See WREVENT_FRAME_DONE
+    atomic_bool frame_requested;
+
+    // Moved by the window manager while the window is being rendered
+    _Atomic int x;
+    _Atomic int y;
+    int width;
+    int height;
+
+    // The client that created the window. Its events are sent there.
+    // Only valid while the window is open
+    Client* client;
 
+    // Pushed to by the window manager, popped from by the dispatcher
     EventList event_list;
-    pthread_mutex_t event_list_mutex;
+    // Set when the window was reported to `event_notifier` and the
+    // dispatcher hasn't started draining `event_list` since
+    atomic_bool events_reported;
 
-    bool event_listener_thread_running;
-    pthread_t event_listener_thread;
-    int event_socket;
+    // Motion events merged into a queued one, and events that didn't fit
+    atomic_size_t events_coalesced;
+    atomic_size_t events_dropped;
+
+    // Told about the window when its event list stops being empty
+    EventNotifier* event_notifier;
 } Window;
 
-Window* window_create(char const* title, int width, int height);
-void window_destroy(Window* window);
+Window* window_create(Client* client, EventNotifier* event_notifier,
+                      char const* title, int width, int height);
+void window_ref(Window* window);
+void window_unref(Window* window);
+
+// Puts `dma_buf` in slot `buffer`, closing the buffer there before.
+// Returns false if the slot is shown or busy
+bool window_set_buffer(Window* window, size_t buffer, WindowDmaBuf dma_buf);
+
+// Shows the buffer in slot `buffer`, making the one shown before busy.
+// `damage` is what changed since the last commit. Takes ownership of
+// `acquire_fence`, which may be -1, on success
+WindowRendererStatus window_commit(Window* window, size_t buffer, WindowRect damage,
+                                   int acquire_fence);
 
+// Puts `dma_buf` in slot 0 and shows it right away, even if slot 0 is
+// shown. Also damages the whole window
+void window_set_dma_buf(Window* window, WindowDmaBuf dma_buf);
+
+// Returns what the window shows. The acquire fence of the commit is
+// only duplicated if the commit isn't `waited_commit`, so that it's
+// waited for once
+WindowShownBuffer window_get_shown_buffer(Window* window, uint64_t waited_commit);
+
+// Returns the buffers that became busy since the last call, as bits
+uint32_t window_take_replaced_buffers(Window* window);
+// Makes `buffers`, given as bits, not busy anymore
+void window_release_buffers(Window* window, uint32_t buffers);
+
+// Adds `rect`, clipped to the window's content, to the window's damage
+void window_damage(Window* window, WindowRect rect);
+// Returns false if the window wasn't damaged since the last call
+bool window_take_damage(Window* window, WindowRect* damage);
+
+// Called from the window manager thread only
 void window_send_event(Window* window, WindowRendererEvent event);
+
+// Called by the dispatcher before it drains `window->event_list`, so
+// that events pushed from then on get the window reported again
+void window_begin_event_delivery(Window* window);
+
+WindowEventStats window_get_event_stats(Window* window);
@@ -0,0 +1,42 @@
+#include "window_stack.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+WindowStack* window_stack_create(Window* const* windows, size_t windows_count)
+{
+    WindowStack* stack = malloc(sizeof(*stack) + windows_count * sizeof(*windows));
+
+    atomic_init(&stack->refs, 1);
+    stack->windows_count = windows_count;
+    memcpy(stack->windows, windows, windows_count * sizeof(*windows));
+
+    for (size_t i = 0; i < windows_count; ++i) {
+        window_ref(windows[i]);
+    }
+
+    return stack;
+}
+
+void window_stack_ref(WindowStack* stack)
+{
+    atomic_fetch_add_explicit(&stack->refs, 1, memory_order_relaxed);
+}
+
+void window_stack_unref(WindowStack* stack)
+{
+    if (atomic_fetch_sub_explicit(&stack->refs, 1, memory_order_acq_rel) != 1)
+        return;
+
+    for (size_t i = 0; i < stack->windows_count; ++i) {
+        window_unref(stack->windows[i]);
+    }
+    free(stack);
+}
+
+Window* window_stack_top(WindowStack* stack)
+{
+    if (stack->windows_count == 0)
+        return NULL;
+    return stack->windows[stack->windows_count - 1];
+}
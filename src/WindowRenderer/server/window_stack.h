@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "window.h"
+
+/*
+ * An immutable copy of the server's window stack, bottom to top.
+ *
+ * The stack holds a reference on each of its windows, so a window stays
+ * alive for as long as a stack it is in is being used, even if it gets
+ * closed in the meantime.
+ */
+typedef struct {
+    atomic_size_t refs;
+
+    size_t windows_count;
+    Window* windows[];
+} WindowStack;
+
+// The returned stack starts with one reference
+WindowStack* window_stack_create(Window* const* windows, size_t windows_count);
+
+void window_stack_ref(WindowStack* stack);
+void window_stack_unref(WindowStack* stack);
+
+// Returns NULL if the stack is empty
+Window* window_stack_top(WindowStack* stack);
@@ -0,0 +1,88 @@
+#include "window_table.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_TABLE_NO_SLOT UINT32_MAX
+
+// Generations are kept small enough for IDs to stay positive ints
+#define WINDOW_TABLE_GENERATION_MASK ((UINT32_C(1) << (31 - WINDOW_TABLE_INDEX_BITS)) - 1)
+
+void window_table_init(WindowTable* table)
+{
+    memset(table, 0, sizeof(*table));
+    table->free_head = WINDOW_TABLE_NO_SLOT;
+}
+
+void window_table_destroy(WindowTable* table)
+{
+    free(table->slots);
+}
+
+int window_table_add(WindowTable* table, Window* window)
+{
+    uint32_t index = table->free_head;
+
+    if (index != WINDOW_TABLE_NO_SLOT) {
+        table->free_head = table->slots[index].next_free;
+    } else {
+        if (table->slots_count == WINDOW_TABLE_SLOTS_MAX)
+            return -1;
+
+        if (table->slots_count == table->slots_capacity) {
+            table->slots_capacity = table->slots_capacity == 0
+                ? 64
+                : table->slots_capacity * 2;
+            table->slots = realloc(table->slots,
+                                   table->slots_capacity * sizeof(*table->slots));
+        }
+
+        index = table->slots_count++;
+        table->slots[index].generation = 0;
+    }
+
+    WindowSlot* slot = &table->slots[index];
+    slot->window = window;
+
+    return (int)((slot->generation << WINDOW_TABLE_INDEX_BITS) | index);
+}
+
+static WindowSlot* window_table_find_slot(WindowTable* table, int id)
+{
+    if (id < 0)
+        return NULL;
+
+    uint32_t index = (uint32_t)id & (WINDOW_TABLE_SLOTS_MAX - 1);
+    uint32_t generation = (uint32_t)id >> WINDOW_TABLE_INDEX_BITS;
+
+    if (index >= table->slots_count)
+        return NULL;
+
+    WindowSlot* slot = &table->slots[index];
+    if (slot->window == NULL || slot->generation != generation)
+        return NULL;
+
+    return slot;
+}
+
+Window* window_table_get(WindowTable* table, int id)
+{
+    WindowSlot* slot = window_table_find_slot(table, id);
+    return slot ? slot->window : NULL;
+}
+
+bool window_table_remove(WindowTable* table, int id)
+{
+    WindowSlot* slot = window_table_find_slot(table, id);
+    if (!slot)
+        return false;
+
+    slot->window = NULL;
+    slot->generation = (slot->generation + 1) & WINDOW_TABLE_GENERATION_MASK;
+
+    slot->next_free = table->free_head;
+    table->free_head = slot - table->slots;
+
+    return true;
+}
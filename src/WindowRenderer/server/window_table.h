@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "window.h"
+
+/*
+ * Maps window IDs to windows in constant time.
+ *
+ * A window ID is the index of the window's slot, plus the generation the
+ * slot was at when the window was added. Removing a window bumps its
+ * slot's generation, so IDs of closed windows are rejected instead of
+ * resolving to whichever window reuses the slot.
+ */
+#define WINDOW_TABLE_INDEX_BITS 20
+#define WINDOW_TABLE_SLOTS_MAX ((size_t)1 << WINDOW_TABLE_INDEX_BITS)
+
+typedef struct {
+    // NULL if the slot is free
+    Window* window;
+    uint32_t generation;
+    // Next slot in the free list, if the slot is free
+    uint32_t next_free;
+} WindowSlot;
+
+typedef struct {
+    WindowSlot* slots;
+    size_t slots_count;
+    size_t slots_capacity;
+
+    // Head of the list of free slots below `slots_count`
+    uint32_t free_head;
+} WindowTable;
+
+void window_table_init(WindowTable* table);
+void window_table_destroy(WindowTable* table);
+
+// Returns the ID the window was added under, or -1 if the table is full
+int window_table_add(WindowTable* table, Window* window);
+
+// Returns NULL if no window has that ID (anymore)
+Window* window_table_get(WindowTable* table, int id);
+
+// Returns false if no window has that ID
+bool window_table_remove(WindowTable* table, int id);
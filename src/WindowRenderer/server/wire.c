@@ -0,0 +1,212 @@
+#include "wire.h"
+
+#include <string.h>
+
+// Size of a response or event frame, given the size of the payload that
+// follows its prefix
+#define RESPONSE_FRAME_SIZE(member_size)                                        \
+    (sizeof(WindowRendererFrameHeader) + sizeof(WindowRendererResponseKind)     \
+     + sizeof(WindowRendererStatus) + (member_size))
+#define EVENT_FRAME_SIZE(member_size) \
+    (sizeof(WindowRendererFrameHeader) + sizeof(WindowRendererEventKind) + (member_size))
+
+#define RESPONSE_MEMBER_SIZE(name) sizeof(((WindowRendererResponse*)0)->response.name)
+#define EVENT_MEMBER_SIZE(name) sizeof(((WindowRendererEvent*)0)->event.name)
+
+_Static_assert(RESPONSE_FRAME_SIZE(RESPONSE_MEMBER_SIZE(window_id)) <= WIRE_RESPONSE_SIZE_MAX,
+               "WRRESP_WINID frames must fit in WIRE_RESPONSE_SIZE_MAX");
+_Static_assert(RESPONSE_FRAME_SIZE(0) <= WIRE_RESPONSE_SIZE_MAX,
+               "WRRESP_EMPTY frames must fit in WIRE_RESPONSE_SIZE_MAX");
+_Static_assert(RESPONSE_FRAME_SIZE(RESPONSE_MEMBER_SIZE(batch)) <= WIRE_RESPONSE_SIZE_MAX,
+               "WRRESP_BATCH frames must fit in WIRE_RESPONSE_SIZE_MAX");
+_Static_assert(WIRE_RESPONSE_SIZE_MAX <= WIRE_MESSAGE_SIZE_MAX,
+               "Response frames must fit in WIRE_MESSAGE_SIZE_MAX");
+
+_Static_assert(EVENT_FRAME_SIZE(0) <= WIRE_MESSAGE_SIZE_MAX,
+               "WREVENT_CLOSE_WINDOW frames must fit in WIRE_MESSAGE_SIZE_MAX");
+_Static_assert(EVENT_FRAME_SIZE(EVENT_MEMBER_SIZE(mouse_button)) <= WIRE_MESSAGE_SIZE_MAX,
+               "WREVENT_MOUSE_BUTTON frames must fit in WIRE_MESSAGE_SIZE_MAX");
+_Static_assert(EVENT_FRAME_SIZE(EVENT_MEMBER_SIZE(mouse_move)) <= WIRE_MESSAGE_SIZE_MAX,
+               "WREVENT_MOUSE_MOVE frames must fit in WIRE_MESSAGE_SIZE_MAX");
+_Static_assert(EVENT_FRAME_SIZE(EVENT_MEMBER_SIZE(frame_done)) <= WIRE_MESSAGE_SIZE_MAX,
+               "WREVENT_FRAME_DONE frames must fit in WIRE_MESSAGE_SIZE_MAX");
+_Static_assert(EVENT_FRAME_SIZE(EVENT_MEMBER_SIZE(buffer_release)) <= WIRE_MESSAGE_SIZE_MAX,
+               "WREVENT_BUFFER_RELEASE frames must fit in WIRE_MESSAGE_SIZE_MAX");
+
+bool wire_decode_command(unsigned char const* data, WindowRendererCommand* command)
+{
+    WindowRendererFrameHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    memset(command, 0, sizeof(*command));
+    command->kind = header.kind;
+    command->request_id = header.id;
+
+    unsigned char const* payload = data + sizeof(header);
+    size_t payload_size = header.size - sizeof(header);
+
+    if (payload_size < sizeof(command->fd_count))
+        return false;
+
+    memcpy(&command->fd_count, payload, sizeof(command->fd_count));
+    payload += sizeof(command->fd_count);
+    payload_size -= sizeof(command->fd_count);
+
+    if (command->fd_count > WR_COMMAND_FDS_MAX)
+        return false;
+
+    void* member = NULL;
+    size_t member_size = 0;
+
+    switch (command->kind) {
+
+    case WRCMD_CREATE_WINDOW: {
+        WindowRendererCreateWindow* create_window = &command->command.create_window;
+
+        size_t fixed_size = sizeof(create_window->width) + sizeof(create_window->height);
+        if (payload_size < fixed_size
+            || payload_size - fixed_size > WR_WINDOW_TITLE_SIZE_MAX - 1)
+            return false;
+
+        memcpy(&create_window->width, payload, sizeof(create_window->width));
+        memcpy(&create_window->height, payload + sizeof(create_window->width),
+               sizeof(create_window->height));
+        // Stays NUL terminated, the struct was zeroed
+        memcpy(create_window->title, payload + fixed_size, payload_size - fixed_size);
+        return true;
+    }
+
+    case WRCMD_CLOSE_WINDOW:
+        member = &command->command.close_window;
+        member_size = sizeof(command->command.close_window);
+        break;
+
+    case WRCMD_SET_WINDOW_DMA_BUF:
+        member = &command->command.set_window_dma_buf;
+        member_size = sizeof(command->command.set_window_dma_buf);
+        break;
+
+    case WRCMD_BATCH:
+        member = &command->command.batch;
+        member_size = sizeof(command->command.batch);
+        break;
+
+    case WRCMD_SET_EVENT_RING:
+        member = &command->command.set_event_ring;
+        member_size = sizeof(command->command.set_event_ring);
+        break;
+
+    case WRCMD_DAMAGE_WINDOW:
+        member = &command->command.damage_window;
+        member_size = sizeof(command->command.damage_window);
+        break;
+
+    case WRCMD_REQUEST_FRAME:
+        member = &command->command.request_frame;
+        member_size = sizeof(command->command.request_frame);
+        break;
+
+    case WRCMD_SET_WINDOW_BUFFER:
+        member = &command->command.set_window_buffer;
+        member_size = sizeof(command->command.set_window_buffer);
+        break;
+
+    case WRCMD_COMMIT_WINDOW:
+        member = &command->command.commit_window;
+        member_size = sizeof(command->command.commit_window);
+        break;
+
+    default:
+        return true;
+    }
+
+    if (payload_size != member_size)
+        return false;
+
+    memcpy(member, payload, member_size);
+    return true;
+}
+
+static size_t encode_frame(unsigned char* data, WindowRendererMessageKind kind, uint32_t id,
+                           void const* prefix, size_t prefix_size,
+                           void const* member, size_t member_size)
+{
+    WindowRendererFrameHeader header = {
+        .size = sizeof(header) + prefix_size + member_size,
+        .version = WR_PROTOCOL_VERSION,
+        .kind = kind,
+        .id = id,
+    };
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), prefix, prefix_size);
+    if (member_size != 0)
+        memcpy(data + sizeof(header) + prefix_size, member, member_size);
+
+    return header.size;
+}
+
+size_t wire_encode_response(unsigned char* data, WindowRendererResponse const* response)
+{
+    struct {
+        WindowRendererResponseKind kind;
+        WindowRendererStatus status;
+    } prefix = { response->kind, response->status };
+
+    void const* member = NULL;
+    size_t member_size = 0;
+
+    switch (response->kind) {
+    case WRRESP_WINID:
+        member = &response->response.window_id;
+        member_size = sizeof(response->response.window_id);
+        break;
+
+    case WRRESP_BATCH:
+        member = &response->response.batch;
+        member_size = sizeof(response->response.batch);
+        break;
+
+    case WRRESP_EMPTY:
+        break;
+    }
+
+    return encode_frame(data, WRMSG_RESPONSE, response->request_id,
+                        &prefix, sizeof(prefix), member, member_size);
+}
+
+size_t wire_encode_event(unsigned char* data, WindowRendererEvent const* event)
+{
+    WindowRendererEventKind prefix = event->kind;
+
+    void const* member = NULL;
+    size_t member_size = 0;
+
+    switch (event->kind) {
+    case WREVENT_MOUSE_BUTTON:
+        member = &event->event.mouse_button;
+        member_size = sizeof(event->event.mouse_button);
+        break;
+
+    case WREVENT_MOUSE_MOVE:
+        member = &event->event.mouse_move;
+        member_size = sizeof(event->event.mouse_move);
+        break;
+
+    case WREVENT_FRAME_DONE:
+        member = &event->event.frame_done;
+        member_size = sizeof(event->event.frame_done);
+        break;
+
+    case WREVENT_BUFFER_RELEASE:
+        member = &event->event.buffer_release;
+        member_size = sizeof(event->event.buffer_release);
+        break;
+
+    case WREVENT_CLOSE_WINDOW:
+        break;
+    }
+
+    return encode_frame(data, WRMSG_EVENT, event->window_id,
+                        &prefix, sizeof(prefix), member, member_size);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "WindowRenderer/windowrenderer.h"
+
+// Big enough for any response frame
+#define WIRE_RESPONSE_SIZE_MAX (sizeof(WindowRendererFrameHeader) + sizeof(WindowRendererResponse))
+
+// Big enough for any message frame the server sends, events included.
+// wire.c checks every kind against it
+#define WIRE_MESSAGE_SIZE_MAX                                       \
+    (sizeof(WindowRendererFrameHeader)                              \
+     + (sizeof(WindowRendererResponse) > sizeof(WindowRendererEvent) \
+            ? sizeof(WindowRendererResponse)                        \
+            : sizeof(WindowRendererEvent)))
+
+/*
+ * Decodes a whole frame, as checked by `wr_check_frame`. The kind and
+ * request ID are always decoded, and so is the file descriptor count if
+ * the payload is big enough for it. Returns false if the payload doesn't
+ * match the kind, or more than WR_COMMAND_FDS_MAX file descriptors are
+ * claimed.
+ *
+ * Command kinds the server doesn't know are decoded without a payload,
+ * and left for the caller to reject.
+ */
+bool wire_decode_command(unsigned char const* data, WindowRendererCommand* command);
+
+// Return the size of the frame written to `data`, which must have room
+// for WIRE_RESPONSE_SIZE_MAX bytes for a response, and
+// WIRE_MESSAGE_SIZE_MAX bytes for an event
+size_t wire_encode_response(unsigned char* data, WindowRendererResponse const* response);
+size_t wire_encode_event(unsigned char* data, WindowRendererEvent const* event);
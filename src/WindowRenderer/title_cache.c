@@ -0,0 +1,47 @@
+#include "title_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+TitleCache* title_cache_create(GlyphAtlas* glyph_atlas, int pixel_size)
+{
+    TitleCache* cache = malloc(sizeof(*cache));
+    memset(cache, 0, sizeof(*cache));
+
+    cache->glyph_atlas = glyph_atlas;
+    cache->pixel_size = pixel_size;
+    window_entries_init(&cache->entries, sizeof(TitleCacheEntry));
+
+    return cache;
+}
+
+static void title_cache_release(void* entry, void* user_data)
+{
+    (void)user_data;
+
+    TitleCacheEntry* title_entry = entry;
+    if (title_entry->title)
+        text_destroy(title_entry->title);
+}
+
+void title_cache_destroy(TitleCache* cache)
+{
+    window_entries_destroy(&cache->entries, title_cache_release, NULL);
+    free(cache);
+}
+
+void title_cache_sync(TitleCache* cache, WindowStack* stack)
+{
+    window_entries_sync(&cache->entries, stack, title_cache_release, NULL);
+}
+
+Text* title_cache_get(TitleCache* cache, size_t stack_index, Window* window, float max_width)
+{
+    TitleCacheEntry* entry = window_entries_get(&cache->entries, stack_index);
+
+    // Titles and window sizes never change, so neither does the layout
+    if (!entry->title)
+        entry->title = text_create(cache->glyph_atlas, window->title, cache->pixel_size, max_width);
+
+    return entry->title;
+}
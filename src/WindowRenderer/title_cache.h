@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "renderer/glyph_atlas.h"
+#include "renderer/text.h"
+#include "server/window.h"
+#include "server/window_stack.h"
+#include "window_entries.h"
+
+/*
+ * Keeps the title of each window laid out across frames. Titles are laid
+ * out the first time they're drawn, and dropped when the window closes.
+ *
+ * Like the glyph atlas they're laid out with, every output has its own
+ * cache, only used from that output's rendering thread.
+ */
+typedef struct {
+    // NULL until the title is first drawn
+    Text* title;
+} TitleCacheEntry;
+
+typedef struct {
+    GlyphAtlas* glyph_atlas;
+    int pixel_size;
+
+    // Of TitleCacheEntry
+    WindowEntries entries;
+} TitleCache;
+
+TitleCache* title_cache_create(GlyphAtlas* glyph_atlas, int pixel_size);
+void title_cache_destroy(TitleCache* cache);
+
+// Lines the cache up with `stack`, dropping the titles of windows that
+// aren't in it anymore. Call it at the start of every frame
+void title_cache_sync(TitleCache* cache, WindowStack* stack);
+
+// Returns the title of the window at `stack_index` in the last synced
+// stack, laying it out to fit in `max_width` if it wasn't yet
+Text* title_cache_get(TitleCache* cache, size_t stack_index, Window* window, float max_width);
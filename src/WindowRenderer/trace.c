@@ -0,0 +1,296 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#define TRACE_THREADS_MAX 64
+#define TRACE_THREAD_NAME_MAX 64
+
+typedef struct {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t arg;
+    uint32_t thread;
+    TraceEvent event;
+} TraceEntry;
+
+/*
+ * `sequence` is one past the index the entry was recorded at, and 0
+ * while it's being written. An entry read while its sequence didn't
+ * change was read whole.
+ */
+typedef struct {
+    atomic_uint_fast64_t sequence;
+    TraceEntry entry;
+} TraceRecord;
+
+typedef struct {
+    uint32_t id;
+    char name[TRACE_THREAD_NAME_MAX];
+} TraceThread;
+
+static char const* trace_event_names[COUNT_TRACE_EVENT] = {
+    [TRACE_INPUT_READ] = "Input read",
+    [TRACE_WM_UPDATE] = "WM update",
+    [TRACE_EVENT_DELIVERY] = "Event delivery",
+    [TRACE_COMMIT] = "Commit",
+    [TRACE_RENDER] = "Render",
+    [TRACE_PAGE_FLIP] = "Page flip",
+};
+
+// How the input serial ties the events of an input together, NULL for
+// events that don't carry one
+static char const* trace_event_flow_phases[COUNT_TRACE_EVENT] = {
+    [TRACE_INPUT_READ] = "s",
+    [TRACE_WM_UPDATE] = "t",
+    [TRACE_RENDER] = "t",
+    [TRACE_PAGE_FLIP] = "f",
+};
+
+struct {
+    // Only written by `trace_init`, before other threads are started
+    bool enabled;
+    char const* path;
+
+    TraceRecord* records;
+    atomic_uint_fast64_t head;
+
+    pthread_mutex_t threads_mutex;
+    TraceThread threads[TRACE_THREADS_MAX];
+    size_t threads_count;
+
+    // Written by `trace_request_dump`
+    int dump_fd;
+} TRACE = { .dump_fd = -1 };
+
+static _Thread_local uint32_t trace_thread_id;
+
+static uint32_t trace_get_thread_id()
+{
+    if (trace_thread_id == 0)
+        trace_thread_id = (uint32_t)syscall(SYS_gettid);
+    return trace_thread_id;
+}
+
+static void trace_request_dump(int signo)
+{
+    (void)signo;
+
+    uint64_t value = 1;
+    ssize_t result = write(TRACE.dump_fd, &value, sizeof(value));
+    (void)result;
+}
+
+bool trace_init()
+{
+    char const* path = getenv(TRACE_ENV);
+    if (!path || path[0] == '\0')
+        return true;
+
+    TRACE.dump_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (TRACE.dump_fd == -1) {
+        log_log(LOG_ERROR, "Could not create trace dump eventfd: %s", strerror(errno));
+        return false;
+    }
+
+    TRACE.records = calloc(TRACE_CAPACITY, sizeof(*TRACE.records));
+    atomic_init(&TRACE.head, 0);
+    pthread_mutex_init(&TRACE.threads_mutex, NULL);
+    TRACE.path = path;
+    TRACE.enabled = true;
+
+    signal(SIGUSR1, trace_request_dump);
+
+    log_log(LOG_INFO, "Tracing to `%s`. Send SIGUSR1 to write the trace", path);
+
+    return true;
+}
+
+void trace_name_thread(char const* name)
+{
+    if (!TRACE.enabled)
+        return;
+
+    uint32_t id = trace_get_thread_id();
+
+    pthread_mutex_lock(&TRACE.threads_mutex);
+
+    TraceThread* thread = NULL;
+    for (size_t i = 0; i < TRACE.threads_count; ++i) {
+        if (TRACE.threads[i].id == id)
+            thread = &TRACE.threads[i];
+    }
+
+    if (!thread && TRACE.threads_count < TRACE_THREADS_MAX)
+        thread = &TRACE.threads[TRACE.threads_count++];
+
+    if (thread) {
+        thread->id = id;
+        snprintf(thread->name, sizeof(thread->name), "%s", name);
+    }
+
+    pthread_mutex_unlock(&TRACE.threads_mutex);
+}
+
+uint64_t trace_now()
+{
+    if (!TRACE.enabled)
+        return 0;
+
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void trace_record(TraceEvent event, uint64_t begin, uint64_t end, uint64_t arg)
+{
+    if (!TRACE.enabled)
+        return;
+
+    uint64_t index = atomic_fetch_add_explicit(&TRACE.head, 1, memory_order_relaxed);
+    TraceRecord* record = &TRACE.records[index % TRACE_CAPACITY];
+
+    atomic_store_explicit(&record->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    record->entry = (TraceEntry) {
+        .begin = begin,
+        .end = end < begin ? begin : end,
+        .arg = arg,
+        .thread = trace_get_thread_id(),
+        .event = event,
+    };
+
+    atomic_store_explicit(&record->sequence, index + 1, memory_order_release);
+}
+
+int trace_get_dump_fd()
+{
+    return TRACE.dump_fd;
+}
+
+// Returns false if the record was overwritten while it was read
+static bool trace_read_record(uint64_t index, TraceEntry* entry)
+{
+    TraceRecord* record = &TRACE.records[index % TRACE_CAPACITY];
+
+    if (atomic_load_explicit(&record->sequence, memory_order_acquire) != index + 1)
+        return false;
+
+    *entry = record->entry;
+    atomic_thread_fence(memory_order_acquire);
+
+    return atomic_load_explicit(&record->sequence, memory_order_relaxed) == index + 1;
+}
+
+static void trace_write_string(FILE* file, char const* string)
+{
+    fputc('"', file);
+    for (char const* c = string; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void trace_write_entry(FILE* file, TraceEntry entry, pid_t pid)
+{
+    // Events tied together by the input serial carry it, the others the
+    // window ID
+    char const* arg_name = trace_event_flow_phases[entry.event] ? "input" : "window";
+
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                  "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"%s\":%llu}}",
+            trace_event_names[entry.event], pid, entry.thread,
+            entry.begin / 1000.0, (entry.end - entry.begin) / 1000.0,
+            arg_name, (unsigned long long)entry.arg);
+
+    char const* flow_phase = trace_event_flow_phases[entry.event];
+    if (!flow_phase || entry.arg == 0)
+        return;
+
+    // Bound to the slice above, so the viewer draws arrows from each
+    // input read to the frames that show it
+    fprintf(file, ",\n{\"name\":\"Input\",\"cat\":\"input\",\"ph\":\"%s\",\"bp\":\"e\","
+                  "\"id\":%llu,\"pid\":%d,\"tid\":%u,\"ts\":%.3f}",
+            flow_phase, (unsigned long long)entry.arg, pid, entry.thread,
+            entry.begin / 1000.0);
+}
+
+/*
+ * Written in the Chrome trace event format, which Perfetto opens as
+ * well. Records being written meanwhile are skipped.
+ */
+bool trace_dump()
+{
+    if (!TRACE.enabled)
+        return true;
+
+    uint64_t value;
+    if (read(TRACE.dump_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        log_log(LOG_WARNING, "Could not read trace dump eventfd: %s", strerror(errno));
+
+    FILE* file = fopen(TRACE.path, "w");
+    if (!file) {
+        log_log(LOG_ERROR, "Could not open `%s` to write the trace: %s",
+                TRACE.path, strerror(errno));
+        return false;
+    }
+
+    pid_t pid = getpid();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                  "\"args\":{\"name\":\"WindowRenderer\"}}",
+            pid);
+
+    pthread_mutex_lock(&TRACE.threads_mutex);
+    for (size_t i = 0; i < TRACE.threads_count; ++i) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                      "\"args\":{\"name\":",
+                pid, TRACE.threads[i].id);
+        trace_write_string(file, TRACE.threads[i].name);
+        fprintf(file, "}}");
+    }
+    pthread_mutex_unlock(&TRACE.threads_mutex);
+
+    uint64_t head = atomic_load_explicit(&TRACE.head, memory_order_acquire);
+    uint64_t first = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+    size_t written = 0;
+
+    for (uint64_t i = first; i < head; ++i) {
+        TraceEntry entry;
+        if (!trace_read_record(i, &entry))
+            continue;
+
+        trace_write_entry(file, entry, pid);
+        written += 1;
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = false;
+
+    if (!ok) {
+        log_log(LOG_ERROR, "Could not write the trace to `%s`", TRACE.path);
+        return false;
+    }
+
+    log_log(LOG_INFO, "Wrote %zu trace events to `%s`", written, TRACE.path);
+    return true;
+}
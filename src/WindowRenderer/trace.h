@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Records when the steps between an input event and the frame showing
+ * it happen, to be looked at in chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is off unless this environment variable is set to the path the
+ * trace gets written to. It's written on SIGUSR1 and when the server
+ * quits, and holds the last TRACE_CAPACITY records.
+ */
+#define TRACE_ENV "WINDOW_RENDERER_TRACE"
+#define TRACE_CAPACITY 65536
+
+typedef enum {
+    // From the kernel timestamp of an evdev event to when it was read
+    TRACE_INPUT_READ,
+    TRACE_WM_UPDATE,
+    // Sending the queued events of a window to its client
+    TRACE_EVENT_DELIVERY,
+    TRACE_COMMIT,
+    TRACE_RENDER,
+    // From the end of the render to when the frame was presented
+    TRACE_PAGE_FLIP,
+    COUNT_TRACE_EVENT,
+} TraceEvent;
+
+// Returns false on error. Does nothing unless TRACE_ENV is set. The
+// records are kept until the process exits, since the mouse threads
+// never stop
+bool trace_init();
+
+// Names the calling thread in the trace
+void trace_name_thread(char const* name);
+
+// CLOCK_MONOTONIC time, in nanoseconds. 0 when tracing is off
+uint64_t trace_now();
+
+/*
+ * Records `event` as going from `begin` to `end`. `arg` is the input
+ * serial for input reads, WM updates, renders and page flips, where 0
+ * means no new input, and the window ID for the others.
+ */
+void trace_record(TraceEvent event, uint64_t begin, uint64_t end, uint64_t arg);
+
+// Becomes readable when the trace should be written. -1 when tracing is
+// off
+int trace_get_dump_fd();
+// Writes what's recorded to the path in TRACE_ENV
+bool trace_dump();
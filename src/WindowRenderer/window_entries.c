@@ -0,0 +1,94 @@
+#include "window_entries.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void window_entries_init(WindowEntries* entries, size_t entry_size)
+{
+    memset(entries, 0, sizeof(*entries));
+    entries->entry_size = entry_size;
+}
+
+void window_entries_destroy(WindowEntries* entries, WindowEntriesRelease release,
+                            void* user_data)
+{
+    for (size_t i = 0; i < entries->entries_count; ++i) {
+        release(window_entries_get(entries, i), user_data);
+    }
+    free(entries->window_ids);
+    free(entries->entries);
+    free(entries->next_window_ids);
+    free(entries->next_entries);
+}
+
+// Returns the position of the entry of `window_id`, or `entries_count`
+// if it has none
+static size_t window_entries_find(WindowEntries* entries, size_t stack_index, int window_id)
+{
+    // Unless windows were opened, closed or raised, the entry is still at
+    // the same position
+    if (stack_index < entries->entries_count && entries->window_ids[stack_index] == window_id)
+        return stack_index;
+
+    for (size_t i = 0; i < entries->entries_count; ++i) {
+        if (entries->window_ids[i] == window_id)
+            return i;
+    }
+
+    return entries->entries_count;
+}
+
+void window_entries_sync(WindowEntries* entries, WindowStack* stack,
+                         WindowEntriesRelease release, void* user_data)
+{
+    size_t entry_size = entries->entry_size;
+
+    if (stack->windows_count > entries->next_entries_capacity) {
+        entries->next_entries_capacity = stack->windows_count;
+        entries->next_window_ids = realloc(entries->next_window_ids,
+                                           entries->next_entries_capacity
+                                               * sizeof(*entries->next_window_ids));
+        entries->next_entries = realloc(entries->next_entries,
+                                        entries->next_entries_capacity * entry_size);
+    }
+
+    for (size_t i = 0; i < stack->windows_count; ++i) {
+        int window_id = stack->windows[i]->id;
+        unsigned char* next_entry = entries->next_entries + i * entry_size;
+        entries->next_window_ids[i] = window_id;
+
+        size_t found = window_entries_find(entries, i, window_id);
+        if (found == entries->entries_count) {
+            memset(next_entry, 0, entry_size);
+            continue;
+        }
+
+        memcpy(next_entry, entries->entries + found * entry_size, entry_size);
+        // Taken, so it isn't released below
+        entries->window_ids[found] = -1;
+    }
+
+    // Whatever is left belongs to closed windows
+    for (size_t i = 0; i < entries->entries_count; ++i) {
+        if (entries->window_ids[i] != -1)
+            release(window_entries_get(entries, i), user_data);
+    }
+
+    int* window_ids = entries->window_ids;
+    unsigned char* entries_data = entries->entries;
+    size_t entries_capacity = entries->entries_capacity;
+
+    entries->window_ids = entries->next_window_ids;
+    entries->entries = entries->next_entries;
+    entries->entries_capacity = entries->next_entries_capacity;
+    entries->entries_count = stack->windows_count;
+
+    entries->next_window_ids = window_ids;
+    entries->next_entries = entries_data;
+    entries->next_entries_capacity = entries_capacity;
+}
+
+void* window_entries_get(WindowEntries* entries, size_t stack_index)
+{
+    return entries->entries + stack_index * entries->entry_size;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "server/window_stack.h"
+
+/*
+ * Per-window entries of a cache, kept across frames and lined up with
+ * the window stack: entry `i` belongs to the window at position `i` of
+ * the last stack passed to `window_entries_sync`. What an entry holds is
+ * up to the cache, the entries only know its size.
+ */
+typedef struct {
+    size_t entry_size;
+
+    int* window_ids;
+    unsigned char* entries;
+    size_t entries_count;
+    size_t entries_capacity;
+
+    // Where `window_entries_sync` puts the entries it keeps
+    int* next_window_ids;
+    unsigned char* next_entries;
+    size_t next_entries_capacity;
+} WindowEntries;
+
+// Called on the entries of windows that aren't in the stack anymore
+typedef void (*WindowEntriesRelease)(void* entry, void* user_data);
+
+void window_entries_init(WindowEntries* entries, size_t entry_size);
+// Releases every entry left
+void window_entries_destroy(WindowEntries* entries, WindowEntriesRelease release,
+                            void* user_data);
+
+// Lines the entries up with `stack`. Entries of windows new to it are
+// zeroed, those of windows no longer in it are released
+void window_entries_sync(WindowEntries* entries, WindowStack* stack,
+                         WindowEntriesRelease release, void* user_data);
+
+// Returns the entry of the window at `stack_index` in the last synced stack
+void* window_entries_get(WindowEntries* entries, size_t stack_index);
@@ -6,6 +6,7 @@
 #include "input_events/mouse.h"
 #include "server/server.h"
 #include "server/window.h"
+#include "trace.h"
 
 #include "WindowRenderer/windowrenderer.h"
 
@@ -19,6 +20,9 @@ static bool check_collision_point_rec(Vector2 point, Vector2 rec_position, Vecto
 
 struct {
     int dragged_window_id;
+    // Last input serial handled, so only the first update after new
+    // input is tied to it in the trace
+    uint64_t input_serial;
 } WM;
 
 void wm_init()
@@ -31,7 +35,12 @@ WMWindowParameters wm_compute_window_parameters(Window* window)
     const float border_thickness = 5.f;
     const float title_bar_thickness = 20.f;
 
-    const Vector2 close_button_position = { window->x, window->y };
+    // The window manager may be moving the window while it's rendered,
+    // so the position is only read once
+    const int x = window->x;
+    const int y = window->y;
+
+    const Vector2 close_button_position = { x, y };
     const Vector2 close_button_size = {
         .x = title_bar_thickness,
         .y = title_bar_thickness,
@@ -47,8 +56,8 @@ WMWindowParameters wm_compute_window_parameters(Window* window)
     };
 
     const Vector2 content_position = {
-        .x = window->x + border_thickness,
-        .y = window->y + title_bar_thickness,
+        .x = x + border_thickness,
+        .y = y + title_bar_thickness,
     };
 
     const Vector2 border_position = {
@@ -85,18 +94,27 @@ WMWindowParameters wm_compute_window_parameters(Window* window)
     };
 }
 
-void wm_update(Server* server)
+void wm_damage_window(Damage* damage, Window* window)
+{
+    WMWindowParameters window_parameters = wm_compute_window_parameters(window);
+    damage_add_rect(damage, window_parameters.total_area_position,
+                    window_parameters.total_area_size);
+}
+
+void wm_update(Server* server, Damage* damage)
 {
+    uint64_t trace_begin = trace_now();
+
     /*
-     * Start updating windows: lock window access
+     * Start updating windows: take the current window stack
      */
-    server_lock_windows(server);
+    WindowStack* stack = server_acquire_windows(server);
 
     // Handle window dragging/events
     {
-        for (size_t i = 0; i < server_get_window_count(server); ++i) {
-            Window* window = server_get_windows(server)[i];
-            bool window_is_active = window->id == server_top_window(server)->id;
+        for (size_t i = 0; i < stack->windows_count; ++i) {
+            Window* window = stack->windows[i];
+            bool window_is_active = window->id == window_stack_top(stack)->id;
             WMWindowParameters window_parameters = wm_compute_window_parameters(window);
 
             // Handle window dragging
@@ -109,9 +127,13 @@ void wm_update(Server* server)
                 }
 
                 if (WM.dragged_window_id == window->id) {
-                    if (window_is_active) {
-                        window->x += get_cursor_delta().x;
-                        window->y += get_cursor_delta().y;
+                    Vector2 cursor_delta = get_cursor_delta();
+                    if (window_is_active && (cursor_delta.x != 0 || cursor_delta.y != 0)) {
+                        // Where the window was, and where it is now
+                        wm_damage_window(damage, window);
+                        window->x += cursor_delta.x;
+                        window->y += cursor_delta.y;
+                        wm_damage_window(damage, window);
                     }
 
                     if (is_mouse_button_just_released(INPUT_MOUSE_BUTTON_LEFT)) {
@@ -176,15 +198,15 @@ void wm_update(Server* server)
     // Handle window focus
     {
         if (is_mouse_button_just_pressed(INPUT_MOUSE_BUTTON_LEFT)
-            && server_get_window_count(server) != 0) {
-            for (size_t i = server_get_window_count(server); i-- > 0;) {
-                Window* window = server_get_windows(server)[i];
+            && stack->windows_count != 0) {
+            for (size_t i = stack->windows_count; i-- > 0;) {
+                Window* window = stack->windows[i];
                 WMWindowParameters window_parameters = wm_compute_window_parameters(window);
 
                 if (check_collision_point_rec(get_cursor_position(),
                                               window_parameters.total_area_position,
                                               window_parameters.total_area_size)) {
-                    if (window->id != server_top_window(server)->id) {
+                    if (window->id != window_stack_top(stack)->id) {
                         server_raise_window(server, window);
                     }
                     break;
@@ -194,7 +216,12 @@ void wm_update(Server* server)
     }
 
     /*
-     * Finish updating windows: unlock window access
+     * Finish updating windows: release the window stack
      */
-    server_unlock_windows(server);
+    window_stack_unref(stack);
+
+    uint64_t input_serial = input_get_serial();
+    trace_record(TRACE_WM_UPDATE, trace_begin, trace_now(),
+                 input_serial != WM.input_serial ? input_serial : 0);
+    WM.input_serial = input_serial;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "damage.h"
 #include "types.h"
 
 #include "server/window.h"
@@ -26,4 +27,7 @@ typedef struct {
 void wm_init();
 
 WMWindowParameters wm_compute_window_parameters(Window* window);
-void wm_update(Server* server);
+// Adds the whole area of the window, decorations included, to `damage`
+void wm_damage_window(Damage* damage, Window* window);
+// Adds whatever changed on screen, like moved windows, to `damage`
+void wm_update(Server* server, Damage* damage);